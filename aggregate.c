@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Telemetry Aggregation
+ *
+ * v.beta
+ */
+
+#include "aggregate.h"
+#include "mesh.h"
+#include "radio.h"
+#include "mac_packet.h"
+#include "payload.h"
+#include "cmd_const.h"
+#include "sys_clock.h"
+
+#include <string.h>
+
+#define MAX_DT                  (32767)
+#define MIN_DT                  (-32768)
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0, is_active = 0;
+static unsigned int dest_addr, num_records;
+static unsigned char addr_high;
+static unsigned long cycle_ticks, cycle_start, base_time;
+
+static AggRecordStruct records[AGG_MAX_RECORDS];
+
+// =========== Function Stubs ==================================================
+static void aggFlush(void);
+
+// =========== Public Functions ================================================
+
+void aggSetup(void) {
+
+    num_records = 0;
+    is_active = 0;
+    is_ready = 1;
+
+}
+
+void aggStart(unsigned int dest, unsigned long cycle) {
+
+    unsigned long now;
+
+    if(!is_ready || cycle == 0) { return; }
+
+    aggFlush();
+    dest_addr = dest;
+    cycle_ticks = cycle;
+    now = sclockGetGlobalTicks();
+    cycle_start = now - now % cycle_ticks;
+    is_active = 1;
+
+}
+
+void aggStop(void) {
+
+    aggFlush();
+    is_active = 0;
+
+}
+
+unsigned char aggIsActive(void) {
+
+    return is_active;
+
+}
+
+void aggAddSamples(unsigned int src_addr, TelemetryCompact samples,
+                    unsigned int num_samples) {
+
+    AggRecord record;
+    unsigned int i;
+    long dt;
+
+    if(!is_active) { return; }
+
+    for(i = 0; i < num_samples; i++) {
+
+        // Start a new packet when the source or time offset does not fit
+        if(num_records > 0) {
+            dt = (long)(samples[i].time - base_time) >> AGG_TIME_SHIFT;
+            if((src_addr >> 8) != addr_high || dt > MAX_DT || dt < MIN_DT) {
+                aggFlush();
+            }
+        }
+        if(num_records == 0) {
+            base_time = samples[i].time;
+            addr_high = src_addr >> 8;
+        }
+        dt = (long)(samples[i].time - base_time) >> AGG_TIME_SHIFT;
+
+        record = &records[num_records++];
+        record->src = src_addr & 0xFF;
+        record->RSSI = samples[i].RSSI;
+        record->dt = (int) dt;
+        memcpy(record->ref, samples[i].ref, sizeof(record->ref));
+        memcpy(record->pose, samples[i].pose, sizeof(record->pose));
+        memcpy(record->u, samples[i].u, sizeof(record->u));
+        record->padding = 0;
+
+        if(num_records >= AGG_MAX_RECORDS) { aggFlush(); }
+
+    }
+
+}
+
+void aggAddPacket(MacPacket packet) {
+
+    Payload pld;
+    unsigned int num_samples;
+
+    pld = macGetPayload(packet);
+    num_samples = payGetDataLength(pld)/TELEMETRY_COMPACT_SIZE;
+    if(payGetStatus(pld) < num_samples) { num_samples = payGetStatus(pld); }
+
+    aggAddSamples(macGetSrcAddr(packet), (TelemetryCompact) payGetData(pld),
+                    num_samples);
+
+}
+
+void aggProcess(void) {
+
+    unsigned long now, start;
+
+    if(!is_active) { return; }
+
+    now = sclockGetGlobalTicks();
+    start = now - now % cycle_ticks;
+    if(start != cycle_start) {
+        aggFlush();
+        cycle_start = start;
+    }
+
+}
+
+// =========== Private Functions ===============================================
+
+static void aggFlush(void) {
+
+    MacPacket packet;
+    Payload pld;
+    AggHeaderStruct header;
+
+    if(num_records == 0) { return; }
+
+    packet = meshRequestPacket(AGG_HEADER_SIZE + num_records*AGG_RECORD_SIZE);
+    if(packet == NULL) {
+        num_records = 0;
+        return;
+    }
+
+    header.base_time = base_time;
+    header.addr_high = addr_high;
+    header.padding = 0;
+
+    pld = macGetPayload(packet);
+    paySetType(pld, CMD_RESPONSE_TELEMETRY_AGGREGATE);
+    paySetStatus(pld, num_records);
+    payAppendData(pld, 0, AGG_HEADER_SIZE, (unsigned char*) &header);
+    payAppendData(pld, AGG_HEADER_SIZE, num_records*AGG_RECORD_SIZE,
+                    (unsigned char*) records);
+
+    if(!meshSend(packet, dest_addr, NULL, NULL)) {
+        radioReturnPacket(packet);
+    }
+    num_records = 0;
+
+}
@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Telemetry Aggregation
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - An aggregator collects compact telemetry from its neighbours and sends
+ *    the samples of each aggregation cycle to the basestation in as few
+ *    packets as possible.
+ *  - Cycles are aligned to the global clock so that all aggregators flush
+ *    together.
+ *  - Record times are offsets from the first record of their packet, up to
+ *    about +-838 ms (32767 units of 16 ticks). A sample further away starts
+ *    a new packet, so cycles of any length keep exact times.
+ *  - Records share the high byte of their source address with the packet
+ *    header. A source from another address block starts a new packet.
+ *  - Records are no smaller than compact samples: the source byte takes the
+ *    space saved by the short time offset. The saving is in packets, which
+ *    carry AGG_MAX_RECORDS samples from any mix of neighbours.
+ *  - Not interrupt safe. Call from the background loop only.
+ */
+
+#ifndef __AGGREGATE_H
+#define __AGGREGATE_H
+
+#include "mac_packet.h"
+#include "telemetry.h"
+
+#define AGG_TIME_SHIFT          (4)     // Record time unit is 16 ticks
+#define AGG_MAX_RECORDS         (4)     // Fills a frame with a mesh trailer
+
+// Aggregate packet header, status byte holds the record count
+typedef struct {
+    unsigned long base_time;    // (4) Global time of first record
+    unsigned char addr_high;    // (1) Source address high byte
+    unsigned char padding;      // (1)
+} AggHeaderStruct;
+
+// One telemetry sample, timed relative to the packet header
+typedef struct {
+    unsigned char src;          // (1) Source address low byte
+    unsigned char RSSI;         // (1) Source link RSSI average
+    int dt;                     // (2) Sample time after base_time
+    int ref[4];                 // (8) Reference
+    int pose[4];                // (8) Position
+    signed char u[3];           // (3) Output scaled to +-127
+    unsigned char padding;      // (1)
+} AggRecordStruct;
+typedef AggRecordStruct* AggRecord;
+
+#define AGG_HEADER_SIZE         (6)
+#define AGG_RECORD_SIZE         (24)
+
+/**
+ * Set up aggregation module. Aggregation starts disabled.
+ */
+void aggSetup(void);
+
+/**
+ * Start aggregating telemetry on this node
+ * @param dest_addr - Address aggregates are sent to
+ * @param cycle_ticks - Aggregation cycle length in system clock ticks
+ */
+void aggStart(unsigned int dest_addr, unsigned long cycle_ticks);
+
+/**
+ * Flush pending records and stop aggregating
+ */
+void aggStop(void);
+
+/**
+ * Whether this node is currently aggregating
+ */
+unsigned char aggIsActive(void);
+
+/**
+ * Add compact telemetry samples with global timestamps
+ * @param src_addr - Node the samples describe
+ * @param samples - Sample array
+ * @param num_samples - Number of samples
+ */
+void aggAddSamples(unsigned int src_addr, TelemetryCompact samples,
+                    unsigned int num_samples);
+
+/**
+ * Add the samples of a CMD_RESPONSE_TELEMETRY_PACKED packet
+ * @param packet - Received packet
+ */
+void aggAddPacket(MacPacket packet);
+
+/**
+ * Background tasks. Flushes records at cycle boundaries.
+ */
+void aggProcess(void);
+
+#endif // __AGGREGATE_H
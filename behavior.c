@@ -50,6 +50,10 @@
 #include "regulator.h"
 #include "behavior.h"
 #include "sys_clock.h"
+#include "triangulate.h"
+#include "journal.h"
+
+#include <math.h>
 
 // ==== CONSTANTS =========================================== 
 #define TRACK_MIN_PIXELS             (4) // Min number of pixels visible to consider a centroid valid
@@ -77,6 +81,8 @@
 #define SEARCH_YAW_MAXIMUM           (0.0)
 #define SEARCH_PERIOD                (25)
 
+#define OBSTACLE_YAW_GAIN            (0.35)  // Max yaw bias in radians
+
 #define DEFAULT_YAW_OFFSET              (0.0)
 #define DEFAULT_PITCH_OFFSET            (80.0)
 
@@ -99,6 +105,11 @@ static unsigned int reacquiringStartTime;
 // Searching behav_state variables
 static unsigned int searchingStartTime;
 
+// Tracking behav_state variables, references follow coarse frames slowly
+static const float level_weight[4] = {1.0, 0.8, 0.5, 0.5}; // By CvLevel
+static unsigned char track_valid;
+static float track_yaw, track_pitch;
+
 // ==== FUNCTION STUBS ======================================
 static void runTrack(void);
 static void runReacquire(void);
@@ -114,6 +125,7 @@ static void transitionCircle(void);
 static void transitionSearch(void);
 
 static void resetOffsets(void);
+static float obstacleYawBias(CvResult info);
 // ==== FUNCTION BODIES =====================================
 
 void behavSetup(void) {
@@ -188,23 +200,39 @@ void behavRunBehavior(void) {
 void runTrack(void) {
 
     CamFrame frame;
-    FrameInfo info;    
-    int cX, cY;
+    CvResultStruct info;
+    float yaw, pitch, weight;
 
     frame = camGetFrame();
     if(frame == NULL) { return; }
     
-    info = cvProcessFrame(frame);
+    cvProcessFrame(frame, &info);
     camReturnFrame(frame);
+    triObserveFrame(&info);
+    telemAddVision(&info);
+    jrnlFrame(&info);
         
     // If enough visible pixels
-    if(info->mass > TRACK_MIN_PIXELS) {                       
+    if(info.mass > TRACK_MIN_PIXELS) {                       
                        
-        cX = info->centroid[0] - info->offset[0];
-        cY = info->centroid[1] - info->offset[1];
+        // World frame bearing is independent of rotation since exposure.
+        // Yaw is positive about +z (left). Pitch follows the regulator's
+        // convention, positive about +y (nose down), so targets above the
+        // horizon give negative pitch.
+        yaw = atan2f(info.bearing[1], info.bearing[0]);
+        pitch = -atan2f(info.bearing[2], sqrtf(info.bearing[0]*info.bearing[0]
+                        + info.bearing[1]*info.bearing[1]));
+
+        weight = track_valid ? level_weight[info.level] : 1.0;
+        yaw = yaw - track_yaw;
+        if(yaw > M_PI) { yaw -= 2.0*M_PI; }
+        else if(yaw < -M_PI) { yaw += 2.0*M_PI; }
+        track_yaw += weight*yaw;
+        track_pitch += weight*(pitch - track_pitch);
+        track_valid = 1;
         
-        rgltrSetYawRef(cX + attGetYaw());
-        rgltrSetPitchRef(cY + attGetPitch());
+        rgltrSetYawRef(track_yaw + obstacleYawBias(&info));
+        rgltrSetPitchRef(track_pitch);
         
         return;
         
@@ -295,6 +323,7 @@ void transitionReacquireTrack(void) {
     
     resetOffsets();                    // Reset to defaults
     //rgltrSetRemoteControl(0);        // Disable RC
+    track_valid = 0;
     behav_state = BEHAV_TRACK;
 
 }
@@ -313,6 +342,7 @@ void transitionSearchTrack(void) {
 
     resetOffsets();                    // Reset to defaults
     //rgltrSetRemoteControl(0);        // Disable RC
+    track_valid = 0;
     behav_state = BEHAV_TRACK;
 
 }
@@ -341,3 +371,24 @@ void resetOffsets(void) {
     rgltrSetRemoteControlValues(DEFAULT_PITCH_OFFSET, DEFAULT_YAW_OFFSET);
 
 }
+
+// Turn away from the more hazardous half of the image. Image left is body
+// +y, so positive yaw turns towards it. Only the tracking state processes
+// frames, so the other states fly without this cue.
+float obstacleYawBias(CvResult info) {
+
+    unsigned int i;
+    int left, right;
+
+    if(info->level > CV_LEVEL_HALF) { return 0.0; } // No obstacle cue
+
+    left = 0;
+    right = 0;
+    for(i = 0; i < CV_HAZARD_SECTORS/2; i++) {
+        left += info->hazard[i];
+        right += info->hazard[CV_HAZARD_SECTORS - 1 - i];
+    }
+
+    return OBSTACLE_YAW_GAIN*(right - left)/(255.0*CV_HAZARD_SECTORS/2);
+
+}
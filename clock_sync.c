@@ -48,6 +48,7 @@
 #include "cmd_const.h"
 #include "sys_clock.h"
 #include "clock_sync.h"
+#include "txq.h"
 #include "led.h"
 // ==== CONSTANTS =============================================================
 
@@ -67,6 +68,7 @@ SyncStatusStruct status;
 // =========== Function Stubs =================================================
 
 static void clksyncSendRequest(SyncStatus sync);
+static void clksyncRequestSent(TxqResult result, void *args);
 static void clksyncProcessSamples(SyncStatus sync);
 
 // =========== Public Functions ===============================================
@@ -125,6 +127,11 @@ void clksyncHandleRequest(MacPacket packet) {
     unsigned long* frame;
     unsigned long s0, m1, m2;
     
+    // Only respond on an idle radio. Queuing delay would corrupt the sample,
+    // and the requester simply retries. Other traffic waiting in txq does not
+    // matter since clock sync packets are sent with strict priority.
+    if(!radioTxQueueEmpty()) { return; }
+
     pld = macGetPayload(packet);
     frame = (unsigned long*) payGetData(pld);
     
@@ -141,13 +148,14 @@ void clksyncHandleRequest(MacPacket packet) {
     paySetData(pld, 4, (unsigned char*) &s0);
     payAppendData(pld, 4, 4, (unsigned char*) & m1);
     
-    // Empty TX queue to minimize time of flight error
-    while(!radioTxQueueEmpty());
-    
     m2 = sclockGetGlobalTicks(); // Get approximate time of flight
     payAppendData(pld, 8, 4, (unsigned char*) & m2);
     
-    while(!radioEnqueueTxPacket(response));
+    if(!txqSend(response, NULL, NULL)) {
+        radioReturnPacket(response);
+        return;
+    }
+    txqProcess();
     radioProcess(); // Fast send
 
 }
@@ -184,6 +192,9 @@ static void clksyncSendRequest(SyncStatus sync) {
     Payload pld;
     unsigned long s0;
     
+    // Only request on an idle link, see clksyncHandleRequest
+    if(!radioTxQueueEmpty()) { return; }
+
     packet = radioRequestPacket(4);
     if(packet == NULL) { return; }
     macSetDestAddr(packet, sync->master_addr);
@@ -191,15 +202,26 @@ static void clksyncSendRequest(SyncStatus sync) {
     pld = macGetPayload(packet);
     paySetType(pld, CMD_CLOCK_UPDATE_REQUEST);
 
-    while(!radioTxQueueEmpty());
-    
     s0 = sclockGetGlobalTicks();
     pld = macGetPayload(packet);
     paySetData(pld, 4, (unsigned char*) &s0);
 
-    while(!radioEnqueueTxPacket(packet));
+    if(!txqSend(packet, &clksyncRequestSent, sync)) {
+        radioReturnPacket(packet);
+        return;
+    }
+    txqProcess();
     radioProcess(); // Fast send
 
+}
+
+// Only count requests that actually made it to the radio
+static void clksyncRequestSent(TxqResult result, void *args) {
+
+    SyncStatus sync = (SyncStatus) args;
+
+    if(result != TXQ_SENT) { return; }
+
     sync->requests++;
     if(sync->requests - sync->responses > MAX_PENDING_REQUESTS) {
         sync->state = STATE_REQUEST_TIMEOUT;        
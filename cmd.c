@@ -69,6 +69,16 @@
 #include "directory.h"
 #include "carray.h"
 #include "slew.h"
+#include "txq.h"
+#include "mesh.h"
+#include "aggregate.h"
+#include "triangulate.h"
+#include "gyro_sampler.h"
+#include "gyro_calib.h"
+#include "sensor_dump.h"
+#include "journal.h"
+#include "schedule.h"
+#include "strobe_plan.h"
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
@@ -85,12 +95,40 @@ typedef union {
     unsigned char cval[2];
 } uByte2;
 
+#define TRANSFER_RESERVE_CREDITS    (4)     // Slots left free for responses
+#define TRANSFER_MAX_IN_FLIGHT      (3)     // Queued well inside txq's timeout
+#define TRANSFER_MEM_PERIOD         (12500) // 20 ms between flash dump packets
+#define RAW_FRAME_BLOCK_SIZE        (75)
+#define SCHED_HEADER_SIZE           (6)     // Fire time, type and status
+
+// Multi-packet transfer state. Fill functions queue at most one packet per
+// call with cmdTransferSent as its callback, return 1 if one was queued and
+// clear active when finished.
+typedef unsigned int (*CmdTransferFill)(void);
+
+typedef struct {
+    unsigned char active;
+    unsigned char in_flight;    // Queued packets not yet sent or dropped
+    unsigned int dest_addr;
+    unsigned int dest_pan;
+    unsigned int pos;           // Primary cursor (entry, page, row)
+    unsigned int sub_pos;       // Secondary cursor (byte, column)
+    unsigned int end;
+    unsigned int chunk;
+    unsigned char count;
+    unsigned long next_time;
+    void *data;
+    CmdTransferFill fill;
+} CmdTransferStruct;
+
 // use an array of function pointer to avoid a number of case statements
 // MAX_CMD_FUNC_SIZE is defined in cmd_const.h
 void (*cmd_func[MAX_CMD_FUNC_SIZE])(MacPacket);
 
 // ==== Static Variables =======================================================
 static CircArray input_queue;
+static CmdTransferStruct transfer;
+static CvResultStruct transfer_info;
 
 // ==== Function Prototypes ====================================================
 static void cmdAddressRequest(MacPacket packet);
@@ -126,9 +164,29 @@ static void cmdCamParamResponse(MacPacket packet);
 
 static void cmdRequestTelemetry(MacPacket packet);
 static void cmdResponseTelemetry(MacPacket packet);
+static void cmdResponseTelemetryPacked(MacPacket packet);
+static void cmdSetAggregator(MacPacket packet);
+
+static void cmdSetAnchor(MacPacket packet);
+static void cmdBearingReport(MacPacket packet);
+static void cmdSetHorizonAiding(MacPacket packet);
+static void cmdSetCvDenoise(MacPacket packet);
+static void cmdSetCvCorners(MacPacket packet);
+static void cmdSetCvDeadline(MacPacket packet);
+static void cmdToggleVisionStreaming(MacPacket packet);
+static void cmdSetXlAiding(MacPacket packet);
 static void cmdRecordTelemetry(MacPacket packet);
 
 static void cmdSetLogging(MacPacket packet);
+static void cmdRecordSensorDump(MacPacket packet);
+static void cmdSensorDumpStatsRequest(MacPacket packet);
+static void cmdRecordJournal(MacPacket packet);
+
+static void cmdScheduled(MacPacket packet);
+static void cmdFireScheduled(MacPacket packet);
+static unsigned int cmdIsSchedulable(unsigned char type);
+
+static void cmdStrobeStatsRequest(MacPacket packet);
 static void cmdGetMemContents(MacPacket packet);
 
 static void cmdRunGyroCalib(MacPacket packet);
@@ -147,9 +205,19 @@ static void cmdSetSlewLimit(MacPacket packet);
 
 static void cmdToggleStreaming(MacPacket packet);
 
+static void cmdTxStatsRequest(MacPacket packet);
+static void cmdRouteAdvert(MacPacket packet);
+static void cmdMeshStatsRequest(MacPacket packet);
+
 static void cmdEcho(MacPacket packet);
 static void cmdNop(MacPacket packet);
 
+static void cmdPumpTransfer(void);
+static void cmdTransferSent(TxqResult result, void *args);
+static unsigned int cmdFillDirDump(void);
+static unsigned int cmdFillMemContents(void);
+static unsigned int cmdFillRawFrame(void);
+
 // =============== Public Functions ============================================
 unsigned int cmdSetup(unsigned int queue_size) {
 
@@ -160,6 +228,10 @@ unsigned int cmdSetup(unsigned int queue_size) {
         return 0;
     }
 
+    transfer.active = 0;
+    transfer.in_flight = 0;
+    schedSetup(&cmdFireScheduled);
+
     // initialize the array of func pointers with Nop()
     for(i = 0; i < MAX_CMD_FUNC_SIZE; ++i) {
         cmd_func[i] = &cmdNop;
@@ -204,8 +276,23 @@ unsigned int cmdSetup(unsigned int queue_size) {
     cmd_func[CMD_RECORD_TELEMETRY] = &cmdRecordTelemetry;
     cmd_func[CMD_REQUEST_TELEMETRY] = &cmdRequestTelemetry;
     cmd_func[CMD_RESPONSE_TELEMETRY] = &cmdResponseTelemetry;
-
-    cmd_func[CMD_RECORD_SENSOR_DUMP] = &cmdSetLogging;
+    cmd_func[CMD_RESPONSE_TELEMETRY_PACKED] = &cmdResponseTelemetryPacked;
+    cmd_func[CMD_SET_AGGREGATOR] = &cmdSetAggregator;
+
+    cmd_func[CMD_SET_ANCHOR] = &cmdSetAnchor;
+    cmd_func[CMD_BEARING_REPORT] = &cmdBearingReport;
+    cmd_func[CMD_SET_HORIZON_AIDING] = &cmdSetHorizonAiding;
+    cmd_func[CMD_SET_CV_DENOISE] = &cmdSetCvDenoise;
+    cmd_func[CMD_SET_CV_CORNERS] = &cmdSetCvCorners;
+    cmd_func[CMD_SET_CV_DEADLINE] = &cmdSetCvDeadline;
+    cmd_func[CMD_TOGGLE_VISION_STREAMING] = &cmdToggleVisionStreaming;
+    cmd_func[CMD_SET_XL_AIDING] = &cmdSetXlAiding;
+
+    cmd_func[CMD_RECORD_SENSOR_DUMP] = &cmdRecordSensorDump;
+    cmd_func[CMD_SENSOR_DUMP_STATS_REQUEST] = &cmdSensorDumpStatsRequest;
+    cmd_func[CMD_RECORD_JOURNAL] = &cmdRecordJournal;
+    cmd_func[CMD_SCHEDULED] = &cmdScheduled;
+    cmd_func[CMD_STROBE_STATS_REQUEST] = &cmdStrobeStatsRequest;
     cmd_func[CMD_GET_MEM_CONTENTS] = &cmdGetMemContents;
     cmd_func[CMD_RUN_GYRO_CALIB] = &cmdRunGyroCalib;
     cmd_func[CMD_GET_GYRO_CALIB_PARAM] = &cmdGetGyroCalibParam;
@@ -220,6 +307,10 @@ unsigned int cmdSetup(unsigned int queue_size) {
     cmd_func[CMD_SET_SLEW_LIMIT] = &cmdSetSlewLimit;
 
     cmd_func[CMD_TOGGLE_STREAMING] = &cmdToggleStreaming;
+
+    cmd_func[CMD_TX_STATS_REQUEST] = &cmdTxStatsRequest;
+    cmd_func[CMD_ROUTE_ADVERT] = &cmdRouteAdvert;
+    cmd_func[CMD_MESH_STATS_REQUEST] = &cmdMeshStatsRequest;
     
     return 1;
     
@@ -237,6 +328,9 @@ void cmdProcessBuffer(void) {
     Payload pld;
     unsigned char command;  
 
+    // Continue any outstanding multi-packet transfer
+    cmdPumpTransfer();
+
     // Check for unprocessed packet
     //packet = radioDequeueRxPacket();
     packet = carrayPopTail(input_queue);
@@ -303,6 +397,10 @@ static void cmdDirUpdateResponse(MacPacket packet) {
 
     for(i = 0; i < num_entries; i++) {        
         entry = dirQueryID(update[i].UUID); // Retrieve entry
+        if(entry == NULL) {                 // Adopt entries made on first contact
+            entry = dirQueryAddress(update[i].address, netGetLocalPanID());
+            if(entry != NULL && entry->uuid != 0) { entry = NULL; }
+        }
         if(entry == NULL) {                 // If not seen, create
             entry = dirAddNew();
             if(entry == NULL) { continue; } // Check for creation failure
@@ -320,7 +418,7 @@ static void cmdDirDumpRequest(MacPacket packet) {
 
     Payload pld;
     MacPacket response;
-    unsigned int *frame, req_addr, req_pan, i, size;
+    unsigned int *frame, req_addr, req_pan;
 
     pld = macGetPayload(packet);
     frame = (unsigned int*) payGetData(pld);
@@ -331,44 +429,33 @@ static void cmdDirDumpRequest(MacPacket packet) {
     // Send all if both addresses 0
     if(req_addr == 0 && req_pan == 0) {
 
-        size = dirGetSize();
-        DirEntry entries[size];
-        dirGetEntries(entries); // Assume we get size # of entries
+        if(transfer.active) { return; } // Busy, requester should retry
+
+        transfer.dest_addr = macGetSrcAddr(packet);
+        transfer.dest_pan = macGetSrcPan(packet);
+        transfer.pos = 0;
+        transfer.fill = &cmdFillDirDump;
+        transfer.active = 1;
+        cmdPumpTransfer();
 
-        i = 0;
-        while(i < size) {
-            
-            response = radioRequestPacket(sizeof(DirEntryStruct));
-            if(response == NULL) { continue; }
-            macSetDestAddr(response, macGetSrcAddr(packet));
-            pld = macGetPayload(response);
-            paySetType(pld, CMD_DIR_DUMP_RESPONSE);
-            paySetData(pld, sizeof(DirEntryStruct), (unsigned char*) entries[i]);
-            while(!radioEnqueueTxPacket(response));
-            i++;
-        }
-                
     } else {
 
         DirEntry entry;
 
         entry = dirQueryAddress(req_addr, req_pan);
         if(entry == NULL) { return; }
-        
-        while(1) {
-            
-            response = radioRequestPacket(sizeof(DirEntryStruct));
-            if(response == NULL) { continue; }
-            macSetDestAddr(response, macGetSrcAddr(packet));
-            pld = macGetPayload(response);
-            paySetType(pld, CMD_DIR_DUMP_RESPONSE);
-            //paySetData(pld, sizeof(DirEntryStruct), (unsigned char*) &entry);
-            memcpy(payGetData(pld), entry, sizeof(DirEntryStruct));
-            while(!radioEnqueueTxPacket(response));
-            break;
+
+        response = meshRequestPacket(sizeof(DirEntryStruct));
+        if(response == NULL) { return; }
+        pld = macGetPayload(response);
+        paySetType(pld, CMD_DIR_DUMP_RESPONSE);
+        //paySetData(pld, sizeof(DirEntryStruct), (unsigned char*) &entry);
+        memcpy(payGetData(pld), entry, sizeof(DirEntryStruct));
+        if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+            radioReturnPacket(response);
         }
     }
-    
+
 }
 
 static void cmdDirDumpResponse(MacPacket packet) {
@@ -515,6 +602,8 @@ static void cmdSetLogging(MacPacket packet) {
     flag = frame[0];
 
     if(flag) {
+        sdumpStop();    // Share the flash log region
+        jrnlStop();
         telemStartLogging();
     } else {
         telemStopLogging();
@@ -522,10 +611,143 @@ static void cmdSetLogging(MacPacket packet) {
 
 }
 
+// Raw gyro and accelerometer recording, first data byte starts or stops
+static void cmdRecordSensorDump(MacPacket packet) {
+
+    Payload pld;
+    unsigned char *frame;
+
+    pld = macGetPayload(packet);
+    frame = payGetData(pld);
+
+    if(frame[0]) {
+        telemStopLogging(); // Share the flash log region
+        jrnlStop();
+        radioSetWatchdogState(0);   // Erase blocks
+        sdumpStart();
+        radioSetWatchdogState(1);
+    } else {
+        sdumpStop();
+    }
+
+}
+
+// Data is the global fire time in ticks (4 bytes), then the type and status
+// of the wrapped command and its data. Shorter data cancels all pending
+// scheduled commands.
+static void cmdScheduled(MacPacket packet) {
+
+    Payload pld, inner;
+    MacPacket copy;
+    unsigned char *frame, type;
+    unsigned int len;
+    unsigned long time;
+
+    pld = macGetPayload(packet);
+    frame = payGetData(pld);
+    len = payGetDataLength(pld);
+
+    if(len < SCHED_HEADER_SIZE) {
+        schedFlush();
+        return;
+    }
+
+    memcpy(&time, frame, sizeof(time));
+    type = frame[4];
+    if(!cmdIsSchedulable(type)) { return; }
+
+    len -= SCHED_HEADER_SIZE;
+    copy = radioRequestPacket(len);
+    if(copy == NULL) { return; }
+    macSetSrc(copy, macGetSrcPan(packet), macGetSrcAddr(packet));
+    inner = macGetPayload(copy);
+    paySetType(inner, type);
+    paySetStatus(inner, frame[5]);
+    paySetData(inner, len, frame + SCHED_HEADER_SIZE);
+
+    if(!schedAdd(time, copy)) {
+        radioReturnPacket(copy);
+    }
+
+}
+
+// Control interrupt context
+static void cmdFireScheduled(MacPacket packet) {
+
+    cmd_func[payGetType(macGetPayload(packet))](packet);
+
+}
+
+// Only handlers that set regulator state without sending or blocking may
+// run from the control interrupt
+static unsigned int cmdIsSchedulable(unsigned char type) {
+
+    switch(type) {
+        case CMD_ROTATE_REF_GLOBAL:
+        case CMD_ROTATE_REF_LOCAL:
+        case CMD_SET_TEMP_ROT:
+        case CMD_SET_REGULATOR_OFFSETS:
+        case CMD_SET_REGULATOR_MODE:
+        case CMD_SET_REGULATOR_REF:
+        case CMD_SET_REGULATOR_PID:
+        case CMD_SET_RC_VALUES:
+        case CMD_SET_RATE_MODE:
+        case CMD_SET_RATE_SLEW:
+        case CMD_SET_SLEW_LIMIT:
+            return 1;
+        default:
+            return 0;
+    }
+
+}
+
+// Input journal for replay, first data byte starts or stops
+static void cmdRecordJournal(MacPacket packet) {
+
+    Payload pld;
+    unsigned char *frame;
+
+    pld = macGetPayload(packet);
+    frame = payGetData(pld);
+
+    if(frame[0]) {
+        telemStopLogging(); // Share the flash log region
+        sdumpStop();
+        radioSetWatchdogState(0);   // Erase blocks
+        jrnlStart();
+        radioSetWatchdogState(1);
+    } else {
+        jrnlStop();
+    }
+
+}
+
+// Status byte selects whether counters are cleared after reading
+static void cmdSensorDumpStatsRequest(MacPacket packet) {
+
+    Payload pld;
+    MacPacket response;
+    SdumpStatsStruct stats;
+
+    pld = macGetPayload(packet);
+    sdumpGetStats(&stats, payGetStatus(pld));
+
+    response = meshRequestPacket(sizeof(SdumpStatsStruct));
+    if(response == NULL) { return; }
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_SENSOR_DUMP_STATS_RESPONSE);
+    paySetStatus(pld, 0);
+    paySetData(pld, sizeof(SdumpStatsStruct), (unsigned char*) &stats);
+
+    if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+        radioReturnPacket(response);
+    }
+
+}
+
 static void cmdGetMemContents(MacPacket packet) {
 
     Payload pld;
-    MacPacket data_packet;
     unsigned char *frame;
     DfmemGeometryStruct geo;
 
@@ -536,36 +758,24 @@ static void cmdGetMemContents(MacPacket packet) {
     unsigned int start_page = frame[0] + (frame[1] << 8);
     unsigned int end_page = frame[2] + (frame[3] << 8);
     unsigned int tx_data_size = frame[4] + (frame[5] << 8);
-    unsigned int page, j;
-    unsigned char count = 0;
-    
-    // Send back memory contents
-    for (page = start_page; page < end_page; ++page) {
-        j = 0;
-        while (j + tx_data_size <= geo.bytes_per_page) {
-            data_packet = NULL;
-            while(data_packet == NULL) {
-                data_packet = radioRequestPacket(tx_data_size);
-            }
-
-            macSetDestAddr(data_packet, 0x1020);
-            macSetDestPan(data_packet, 0x1005);
-            pld = macGetPayload(data_packet);
-
-            dfmemRead(page, j, tx_data_size, payGetData(pld));
-
-            paySetStatus(pld, count++);
-            paySetType(pld, CMD_RESPONSE_TELEMETRY);
-            while(!radioEnqueueTxPacket(data_packet));
-            j += tx_data_size;
-            delay_ms(20);
-        }
 
-    }
+    if(transfer.active) { return; } // Busy, requester should retry
+    if(tx_data_size == 0 || tx_data_size > geo.bytes_per_page) { return; }
+    if(start_page >= end_page) { return; }
+
+    // Send back memory contents from the background loop
+    transfer.dest_addr = 0x1020;
+    transfer.dest_pan = 0x1005;
+    transfer.pos = start_page;
+    transfer.sub_pos = 0;
+    transfer.end = end_page;
+    transfer.chunk = tx_data_size;
+    transfer.count = 0;
+    transfer.next_time = sclockGetLocalTicks();
+    transfer.fill = &cmdFillMemContents;
+    transfer.active = 1;
+    cmdPumpTransfer();
 
-    // Signal end of transfer    
-    LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
-    
 }
 
 static void cmdRunGyroCalib(MacPacket packet) {
@@ -575,9 +785,8 @@ static void cmdRunGyroCalib(MacPacket packet) {
     
     unsigned int count = frame[0];
 
-    radioSetWatchdogState(0);
-    gyroRunCalib(count);
-    radioSetWatchdogState(1);
+    // Samples are taken by the control loop, robot must be held still
+    gcalStart(count);
 
 }
 
@@ -590,20 +799,24 @@ static void cmdGetGyroCalibParam(MacPacket packet) {
     
     Payload pld;
     MacPacket response;
+    float offset[3];
     
-    response = radioRequestPacket(12);
+    response = meshRequestPacket(12);
     if(response == NULL) { return; }
-    macSetDestAddr(response, srcAddr);
     pld = response->payload;
-    paySetData(pld, 12, gyroGetCalibParam());
+    gcalGetOffset(offset);
+    paySetData(pld, 12, (unsigned char*) offset);
     paySetStatus(pld, 0);
     paySetType(pld, CMD_GET_GYRO_CALIB_PARAM);
-    while(!radioEnqueueTxPacket(response));
+    if(!meshSend(response, srcAddr, NULL, NULL)) {
+        radioReturnPacket(response);
+    }
 }
 
+// Regulator state logging, formerly on CMD_RECORD_SENSOR_DUMP
 static void cmdRecordTelemetry(MacPacket packet) {
 
-    
+    cmdSetLogging(packet);
 
 }
 
@@ -619,6 +832,35 @@ static void cmdResponseTelemetry(MacPacket packet) {
     
 }
 
+// Only aggregators receive packed telemetry
+static void cmdResponseTelemetryPacked(MacPacket packet) {
+
+    aggAddPacket(packet);
+
+}
+
+// Data is aggregator address and cycle length in ms. The named node
+// aggregates for the sender, every other node streams through it. Address 0
+// disables aggregation.
+static void cmdSetAggregator(MacPacket packet) {
+
+    Payload pld;
+    unsigned int *frame, agg_addr, cycle_ms;
+
+    pld = macGetPayload(packet);
+    frame = (unsigned int*) payGetData(pld);
+    agg_addr = frame[0];
+    cycle_ms = frame[1];
+
+    if(agg_addr == netGetLocalAddress()) {
+        aggStart(macGetSrcAddr(packet), (unsigned long) cycle_ms*625);
+    } else {
+        aggStop();
+    }
+    telemSetAggregator(agg_addr);
+
+}
+
 static void cmdSetEstimateRunning(MacPacket packet) {
         
     Payload pld = macGetPayload(packet);
@@ -639,83 +881,159 @@ static void cmdToggleStreaming(MacPacket packet) {
     
 }
 
-// ====== Camera and Vision ===================================================
-// TODO: Use a struct to simplify the packetization
-static void cmdRequestRawFrame(MacPacket packet) {
-    
-    unsigned int srcAddr, srcPan, height, width, i, temp;
-    unsigned int sent, to_send, block_size = 75;
-    MacPacket response;
+// Status byte selects whether counters are cleared after reading
+static void cmdTxStatsRequest(MacPacket packet) {
+
     Payload pld;
-    CamFrame frame;
-    CamRow *row;
-    CvResultStruct info;
+    MacPacket response;
+    TxqStatsStruct stats;
+    unsigned int i;
+    unsigned char clear;
 
-    srcAddr = macGetSrcAddr(packet);
-    srcPan = macGetSrcPan(packet);    
+    pld = macGetPayload(packet);
+    clear = payGetStatus(pld);
 
-    frame = NULL;
-    while(frame == NULL) {
-        frame = camGetFrame();
-    }           
+    response = meshRequestPacket(TXQ_NUM_CLASSES*sizeof(TxqStatsStruct));
+    if(response == NULL) { return; }
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_TX_STATS_RESPONSE);
+    paySetStatus(pld, TXQ_NUM_CLASSES);
 
-    cvProcessFrame(frame, &info);    
+    for(i = 0; i < TXQ_NUM_CLASSES; i++) {
+        txqGetStats(i, &stats, clear);
+        payAppendData(pld, i*sizeof(TxqStatsStruct), sizeof(TxqStatsStruct),
+                    (unsigned char*) &stats);
+    }
 
-    height = DS_IMAGE_ROWS;
-    width = DS_IMAGE_COLS;
+    if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+        radioReturnPacket(response);
+    }
+
+}
 
-    for(i = 0; i < height; i++) {        
-        row = &(frame->pixels[i]);
-        to_send = width;
-        while(to_send > 0) {            
-            response = radioRequestPacket(block_size + 6);
-            if(response == NULL) { continue; }
-            pld = macGetPayload(response);
-            paySetType(pld, CMD_RAW_FRAME_RESPONSE);
-            paySetStatus(pld, 0);
-            macSetDestAddr(response, srcAddr);
-            macSetDestPan(response, srcPan);
-            temp = frame->frame_num;
-            paySetData(pld, 2, (unsigned char *)&temp);
-            temp = i;
-            payAppendData(pld, 2, 2, (unsigned char*)&temp);
-            temp = width - to_send;
-            payAppendData(pld, 4, 2, (unsigned char*)&temp);
-            temp = (block_size < to_send) ? block_size : to_send;
-            payAppendData(pld, 6, temp, *row + (width - to_send));
-
-            while(!radioEnqueueTxPacket(response));
-
-            to_send = to_send - temp;
+static void cmdRouteAdvert(MacPacket packet) {
 
-        }
+    meshHandleAdvert(packet);
+
+}
+
+// Status byte selects whether counters are cleared after reading
+static void cmdMeshStatsRequest(MacPacket packet) {
+
+    Payload pld;
+    MacPacket response;
+    MeshStatsStruct stats;
+
+    pld = macGetPayload(packet);
+    meshGetStats(&stats, payGetStatus(pld));
+
+    response = meshRequestPacket(sizeof(MeshStatsStruct));
+    if(response == NULL) { return; }
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_MESH_STATS_RESPONSE);
+    paySetStatus(pld, 0);
+    paySetData(pld, sizeof(MeshStatsStruct), (unsigned char*) &stats);
 
+    if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+        radioReturnPacket(response);
     }
-    sent = 0;
-    while(!sent) {
-        response = radioRequestPacket(10);
-        if(response == NULL) { continue; }
-        pld = macGetPayload(response);
-        paySetType(pld, CMD_CENTROID_REPORT);
-        paySetStatus(pld, 1);
-        macSetDestAddr(response, srcAddr);
-        macSetDestPan(response, srcPan);
-        temp = info.centroid[0];
-        paySetData(pld, 2, (unsigned char*)&temp);
-        temp = info.centroid[1];
-        payAppendData(pld, 2, 2, (unsigned char*)&temp);
-        temp = info.max[0];
-        payAppendData(pld, 4, 2, (unsigned char*)&temp);
-        temp = info.max[1];
-        payAppendData(pld, 6, 2, (unsigned char*)&temp);
-        temp = info.max_lum;
-        payAppendData(pld, 8, 1, (unsigned char*)&temp);
-        temp = info.avg_lum;
-        payAppendData(pld, 9, 1, (unsigned char*)&temp);
-        while(!radioEnqueueTxPacket(response));
-        sent = 1;
+
+}
+
+// ====== Camera and Vision ===================================================
+// Status byte set fixes position to the three floats in data, cleared
+// releases it
+static void cmdSetAnchor(MacPacket packet) {
+
+    Payload pld;
+
+    pld = macGetPayload(packet);
+    if(payGetStatus(pld)) {
+        triSetAnchor((float*) payGetData(pld));
+    } else {
+        triSetAnchor(NULL);
     }
-    camReturnFrame(frame);
+
+}
+
+static void cmdBearingReport(MacPacket packet) {
+
+    triHandleReport(packet);
+
+}
+
+static void cmdSetHorizonAiding(MacPacket packet) {
+
+    Payload pld;
+
+    pld = macGetPayload(packet);
+    cvSetHorizonAiding(*((float*) payGetData(pld)));
+
+}
+
+static void cmdSetCvDenoise(MacPacket packet) {
+
+    Payload pld;
+
+    pld = macGetPayload(packet);
+    cvSetDenoise(payGetData(pld)[0]);
+
+}
+
+static void cmdSetCvCorners(MacPacket packet) {
+
+    Payload pld;
+
+    pld = macGetPayload(packet);
+    cvSetCornerThreshold(payGetData(pld)[0]);
+
+}
+
+static void cmdSetCvDeadline(MacPacket packet) {
+
+    Payload pld;
+    unsigned int deadline_ms;
+
+    pld = macGetPayload(packet);
+    deadline_ms = *((unsigned int*) payGetData(pld));
+    cvSetFrameDeadline((unsigned long) deadline_ms*625);
+
+}
+
+static void cmdToggleVisionStreaming(MacPacket packet) {
+
+    telemToggleVisionStreaming(macGetSrcAddr(packet));
+
+}
+
+// Data is proportional and integral gain as floats
+static void cmdSetXlAiding(MacPacket packet) {
+
+    Payload pld;
+    float *gains;
+
+    pld = macGetPayload(packet);
+    gains = (float*) payGetData(pld);
+    gsampSetCorrectionGains(gains[0], gains[1]);
+
+}
+
+// TODO: Use a struct to simplify the packetization
+static void cmdRequestRawFrame(MacPacket packet) {
+    
+    if(transfer.active) { return; } // Busy, requester should retry
+
+    // Frame is acquired and sent from the background loop
+    transfer.dest_addr = macGetSrcAddr(packet);
+    transfer.dest_pan = macGetSrcPan(packet);
+    transfer.data = NULL;
+    transfer.pos = 0;
+    transfer.sub_pos = 0;
+    transfer.end = DS_IMAGE_ROWS;
+    transfer.chunk = RAW_FRAME_BLOCK_SIZE;
+    transfer.fill = &cmdFillRawFrame;
+    transfer.active = 1;
+    cmdPumpTransfer();
 
 }
 
@@ -745,16 +1063,17 @@ static void cmdCamParamRequest(MacPacket packet) {
     pld = macGetPayload(packet);
     camGetParams(&params);
     
-    response = radioRequestPacket(sizeof(CamParamStruct));
+    response = meshRequestPacket(sizeof(CamParamStruct));
     if(response == NULL) { return; }
     
-    macSetDestAddr(response, macGetSrcAddr(packet));
     pld = macGetPayload(response);
     paySetType(pld, CMD_CAM_PARAM_RESPONSE);
     paySetStatus(pld, 0);
     paySetData(pld, sizeof(CamParamStruct), (unsigned char*)&params);
 
-    while(!radioEnqueueTxPacket(response));
+    if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+        radioReturnPacket(response);
+    }
 
 
 }
@@ -764,7 +1083,6 @@ static void cmdCamParamResponse(MacPacket packet) {
     Payload pld;
     unsigned char *frame;
     CamParamStruct *params;
-    LStrobeParamStruct lstrobe_params;
     DirEntry entry;
     unsigned int addr, pan;
     
@@ -779,19 +1097,39 @@ static void cmdCamParamResponse(MacPacket packet) {
     if(entry == NULL) { return; }
     entry->frame_period = params->frame_period;
     entry->frame_start = params->frame_start;
+    entry->timestamp = sclockGetLocalTicks();
 
-    lstrobe_params.period = 5*(params->frame_period/4);
-    lstrobe_params.period_offset = (params->frame_start/4) % (params->frame_period/4);
-    lstrobe_params.on_time = 625/4; // 1 ms
-    lstrobe_params.off_time = lstrobe_params.period - lstrobe_params.on_time;
-    lstrobeSetParam(&lstrobe_params);
-    lstrobeStart();
+    splanInvalidate();  // Strobe slot may move
     
 }
 
+// Status byte selects whether statistics are cleared after reading
+static void cmdStrobeStatsRequest(MacPacket packet) {
+
+    Payload pld;
+    MacPacket response;
+    LStrobeStatsStruct stats;
+
+    pld = macGetPayload(packet);
+    lstrobeGetStats(&stats, payGetStatus(pld));
+
+    response = meshRequestPacket(sizeof(LStrobeStatsStruct));
+    if(response == NULL) { return; }
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_STROBE_STATS_RESPONSE);
+    paySetStatus(pld, 0);
+    paySetData(pld, sizeof(LStrobeStatsStruct), (unsigned char*) &stats);
+
+    if(!meshSend(response, macGetSrcAddr(packet), NULL, NULL)) {
+        radioReturnPacket(response);
+    }
+
+}
+
 static void cmdZeroEstimate(MacPacket packet) {
 
     attReset();
+    gsampReset();
     //xlReadXYZ();
     //attZero();
 
@@ -834,6 +1172,193 @@ void cmdSetSlewLimit(MacPacket packet) {
     
 }
 
+/*-----------------------------------------------------------------------------
+ *          Multi-packet transfers
+-----------------------------------------------------------------------------*/
+static void cmdPumpTransfer(void) {
+
+    // Leave credits free so single responses are never starved, and keep
+    // only a few packets queued so none of them sit long enough to expire
+    while(transfer.active && txqGetCredits() > TRANSFER_RESERVE_CREDITS
+            && transfer.in_flight < TRANSFER_MAX_IN_FLIGHT) {
+        if(!transfer.fill()) { break; }
+        transfer.in_flight++;
+    }
+
+}
+
+// Packets from a finished transfer may complete after the next one starts;
+// they still held a slot, so the count stays shared
+static void cmdTransferSent(TxqResult result, void *args) {
+
+    (void) result;
+    (void) args;
+    if(transfer.in_flight > 0) { transfer.in_flight--; }
+
+}
+
+static unsigned int cmdFillDirDump(void) {
+
+    MacPacket response;
+    Payload pld;
+    unsigned int size;
+
+    size = dirGetSize();
+    if(transfer.pos >= size) {
+        transfer.active = 0;
+        return 0;
+    }
+
+    DirEntry entries[size];
+    dirGetEntries(entries); // Assume we get size # of entries
+
+    response = radioRequestPacket(sizeof(DirEntryStruct));
+    if(response == NULL) { return 0; }
+    macSetDestAddr(response, transfer.dest_addr);
+    macSetDestPan(response, transfer.dest_pan);
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_DIR_DUMP_RESPONSE);
+    paySetData(pld, sizeof(DirEntryStruct), (unsigned char*) entries[transfer.pos]);
+    if(!txqSend(response, &cmdTransferSent, NULL)) {
+        radioReturnPacket(response);
+        return 0;
+    }
+
+    transfer.pos++;
+    if(transfer.pos >= size) { transfer.active = 0; }
+    return 1;
+
+}
+
+static unsigned int cmdFillMemContents(void) {
+
+    MacPacket data_packet;
+    Payload pld;
+    DfmemGeometryStruct geo;
+    unsigned long now;
+
+    now = sclockGetLocalTicks();
+    if((long)(now - transfer.next_time) < 0) { return 0; } // Pacing
+
+    data_packet = radioRequestPacket(transfer.chunk);
+    if(data_packet == NULL) { return 0; }
+
+    macSetDestAddr(data_packet, transfer.dest_addr);
+    macSetDestPan(data_packet, transfer.dest_pan);
+    pld = macGetPayload(data_packet);
+
+    dfmemRead(transfer.pos, transfer.sub_pos, transfer.chunk, payGetData(pld));
+
+    paySetStatus(pld, transfer.count);
+    paySetType(pld, CMD_RESPONSE_TELEMETRY);
+    if(!txqSendClass(data_packet, TXQ_CLASS_BULK,
+                        &cmdTransferSent, NULL)) {
+        radioReturnPacket(data_packet);
+        return 0;
+    }
+
+    transfer.count++;
+    transfer.next_time = now + TRANSFER_MEM_PERIOD;
+
+    // Advance to next chunk, wrapping to the next page
+    dfmemGetGeometryParams(&geo);
+    transfer.sub_pos += transfer.chunk;
+    if(transfer.sub_pos + transfer.chunk > geo.bytes_per_page) {
+        transfer.sub_pos = 0;
+        transfer.pos++;
+    }
+
+    if(transfer.pos >= transfer.end) {
+        transfer.active = 0;
+        // Signal end of transfer
+        LED_GREEN = 0; LED_RED = 0; LED_ORANGE = 0;
+    }
+    return 1;
+
+}
+
+static unsigned int cmdFillRawFrame(void) {
+
+    unsigned int width, temp;
+    MacPacket response;
+    Payload pld;
+    CamFrame frame;
+    CamRow *row;
+
+    // Acquire and process a frame before sending anything
+    if(transfer.data == NULL) {
+        frame = camGetFrame();
+        if(frame == NULL) { return 0; }
+        cvProcessFrame(frame, &transfer_info);
+        transfer.data = frame;
+    }
+
+    frame = (CamFrame) transfer.data;
+    width = DS_IMAGE_COLS;
+
+    // Rows are finished, send centroid report as the tail
+    if(transfer.pos >= transfer.end) {
+
+        response = radioRequestPacket(10);
+        if(response == NULL) { return 0; }
+        pld = macGetPayload(response);
+        paySetType(pld, CMD_CENTROID_REPORT);
+        paySetStatus(pld, 1);
+        macSetDestAddr(response, transfer.dest_addr);
+        macSetDestPan(response, transfer.dest_pan);
+        temp = transfer_info.centroid[0];
+        paySetData(pld, 2, (unsigned char*)&temp);
+        temp = transfer_info.centroid[1];
+        payAppendData(pld, 2, 2, (unsigned char*)&temp);
+        temp = transfer_info.max[0];
+        payAppendData(pld, 4, 2, (unsigned char*)&temp);
+        temp = transfer_info.max[1];
+        payAppendData(pld, 6, 2, (unsigned char*)&temp);
+        temp = transfer_info.max_lum;
+        payAppendData(pld, 8, 1, (unsigned char*)&temp);
+        temp = transfer_info.avg_lum;
+        payAppendData(pld, 9, 1, (unsigned char*)&temp);
+        if(!txqSend(response, &cmdTransferSent, NULL)) {
+            radioReturnPacket(response);
+            return 0;
+        }
+
+        camReturnFrame(frame);
+        transfer.data = NULL;
+        transfer.active = 0;
+        return 1;
+
+    }
+
+    row = &(frame->pixels[transfer.pos]);
+    temp = width - transfer.sub_pos;
+    if(temp > transfer.chunk) { temp = transfer.chunk; }
+
+    response = radioRequestPacket(transfer.chunk + 6);
+    if(response == NULL) { return 0; }
+    pld = macGetPayload(response);
+    paySetType(pld, CMD_RAW_FRAME_RESPONSE);
+    paySetStatus(pld, 0);
+    macSetDestAddr(response, transfer.dest_addr);
+    macSetDestPan(response, transfer.dest_pan);
+    paySetData(pld, 2, (unsigned char *)&frame->frame_num);
+    payAppendData(pld, 2, 2, (unsigned char*)&transfer.pos);
+    payAppendData(pld, 4, 2, (unsigned char*)&transfer.sub_pos);
+    payAppendData(pld, 6, temp, *row + transfer.sub_pos);
+    if(!txqSend(response, &cmdTransferSent, NULL)) {
+        radioReturnPacket(response);
+        return 0;
+    }
+
+    transfer.sub_pos += temp;
+    if(transfer.sub_pos >= width) {
+        transfer.sub_pos = 0;
+        transfer.pos++;
+    }
+    return 1;
+
+}
+
 /*-----------------------------------------------------------------------------
  *          AUX functions
 -----------------------------------------------------------------------------*/
@@ -856,7 +1381,9 @@ static void cmdEcho(MacPacket packet) {
     paySetStatus(pld, status);
     paySetType(pld, CMD_ECHO);
     
-    while(!radioEnqueueTxPacket(response));
+    if(!txqSend(response, NULL, NULL)) {
+        radioReturnPacket(response);
+    }
 }
 
 static void cmdNop(MacPacket packet) {
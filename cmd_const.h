@@ -44,7 +44,7 @@
 #ifndef __CMD_CONST_H
 #define __CMD_CONST_H
 
-#define MAX_CMD_FUNC_SIZE               (0x60) // 0x00 - 0x3F
+#define MAX_CMD_FUNC_SIZE               (0x80) // 0x00 - 0x7F
 
 // CMD values of 0x00(0) - 0x3F(127) are defined here
 // Values 0x00 through 0x10 are reserved for bootloader
@@ -75,7 +75,7 @@
 #define CMD_SET_RATE_SLEW               (0x27)      // Set position slew rate
 
 // for IMU
-#define CMD_RECORD_SENSOR_DUMP          (0x28)      // Begin saving IMU data to flash
+#define CMD_RECORD_SENSOR_DUMP          (0x28)      // Begin saving raw IMU data to flash
 #define CMD_GET_MEM_CONTENTS            (0x29)      // Transmit data in flash
 #define CMD_RUN_GYRO_CALIB              (0x2A)      // Begin gyroscope calibration procedure
 #define CMD_GET_GYRO_CALIB_PARAM        (0x2B)      // get gyroscope calibration offset
@@ -116,6 +116,33 @@
 
 #define CMD_TOGGLE_STREAMING            (0x54)      // Toggle telemetry streaming
 
+#define CMD_TX_STATS_REQUEST            (0x55)      // Request transmit queue statistics
+#define CMD_TX_STATS_RESPONSE           (0x56)      // Per-class transmit queue statistics
+#define CMD_RESPONSE_TELEMETRY_PACKED   (0x57)      // Several compact telemetry samples
+
+#define CMD_MESH_FORWARD                (0x58)      // Multi-hop packet with mesh trailer
+#define CMD_ROUTE_ADVERT                (0x59)      // Distance vector route advertisement
+#define CMD_MESH_STATS_REQUEST          (0x5A)      // Request mesh forwarding statistics
+#define CMD_MESH_STATS_RESPONSE         (0x5B)      // Mesh forwarding statistics
+#define CMD_SET_AGGREGATOR              (0x5C)      // Assign telemetry aggregator
+#define CMD_RESPONSE_TELEMETRY_AGGREGATE (0x5D)     // Aggregated telemetry records
+#define CMD_SET_ANCHOR                  (0x5E)      // Fix or release own position
+#define CMD_BEARING_REPORT              (0x5F)      // Timestamped beacon bearings
+
+#define CMD_SET_HORIZON_AIDING          (0x60)      // Horizon tilt correction gain
+#define CMD_SET_CV_DENOISE              (0x61)      // Select frame denoise filter
+#define CMD_SET_CV_CORNERS              (0x62)      // FAST corner contrast threshold
+#define CMD_SET_CV_DEADLINE             (0x63)      // Vision processing time budget
+#define CMD_TOGGLE_VISION_STREAMING     (0x64)      // Start/stop vision digest stream
+#define CMD_RESPONSE_VISION_PACKED      (0x65)      // Several vision digests
+#define CMD_SET_XL_AIDING               (0x66)      // Accelerometer correction gains
+#define CMD_SENSOR_DUMP_STATS_REQUEST   (0x67)      // Request raw recorder counters
+#define CMD_SENSOR_DUMP_STATS_RESPONSE  (0x68)      // Raw recorder counters
+#define CMD_RECORD_JOURNAL              (0x69)      // Start/stop input journal for replay
+#define CMD_SCHEDULED                   (0x6A)      // Command to run at a global time
+#define CMD_STROBE_STATS_REQUEST        (0x6B)      // Request strobe phase error statistics
+#define CMD_STROBE_STATS_RESPONSE       (0x6C)      // Strobe phase error statistics
+
 // CMD values of 0x80(128) - 0xEF(239) are reserved.
 // CMD values of 0xF0(240) - 0xFF(255) are reserved for future use
 
@@ -38,18 +38,49 @@
 *  Humphrey Hu      2012-02-16      Complete rewrite to use camera driver
 */
 
-#include "attitude.h"
+#include "gyro_sampler.h"
 #include "cv.h"
 #include "cam.h"
 #include "counter.h"
 #include "utils.h"
 #include "bams.h" // For fast trig
 #include "sqrti.h" // For fast integer square root
+#include "sys_clock.h"
+#include "pose_history.h"
+#include "lstrobe.h"
+#include "directory.h"
+#include "tilt_correct.h"
 
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define BLOB_GAP                (2)     // Pixel gap still joining a beacon
+#define TRACK_RADIUS            (8)     // Max beacon motion between sightings
+#define TRACK_LOST_MASK         (0x07)  // Dark periods before a track is dropped
+
+#define HORIZON_EDGE_THRESHOLD  (40)    // Minimum Sobel magnitude of an edge
+#define HORIZON_MIN_INLIERS     (16)    // Columns that must agree on the line
+#define HORIZON_ITERATIONS      (16)    // RANSAC hypotheses per frame
+#define HORIZON_INLIER_DIST     (1.5)   // Max row distance from the line
+
+#define OBSTACLE_EDGE_THRESHOLD (24)    // Minimum Sobel magnitude of an edge
+#define OBSTACLE_AVG_SHIFT      (2)     // Density history, 1/4 per frame
+#define OBSTACLE_LOOM_GAIN      (4)     // Weight of density growth
+
+#define BIN_THRESHOLD           (30)    // cvBinary() foreground threshold
+#define HIST_SHIFT              (4)     // Luminosity to histogram bin
+#define LEVEL_HOLD_FRAMES       (8)     // Fast frames before raising resolution
+
+#define FAST_RADIUS             (3)     // Radius of the test circle
+#define FAST_CIRCLE_SIZE        (16)
+
+// Bright pixel cluster within one frame
+typedef struct {
+    unsigned int sum_col, sum_row, count;
+    unsigned char min_col, max_col, max_row;
+} BlobDetectStruct;
+
 // =========== Static Variables ================================================
 
 // State info
@@ -57,6 +88,43 @@ static unsigned char is_ready, high_pass_on;
 
 static CamFrame background_frame;
 
+// Pinhole model, tangent of the angle off the optical axis per column/row
+static float focal_length, center[2];
+static float col_tan[DS_IMAGE_COLS], row_tan[DS_IMAGE_ROWS];
+
+static CvBlobStruct tracks[CV_MAX_BLOBS];
+
+static float horizon_gain;
+static unsigned char denoise_mode;
+
+static unsigned char corner_threshold;
+static CvCornerStruct corners[CV_MAX_CORNERS];
+static unsigned int num_corners;
+
+// Resolution scheduling
+static unsigned long frame_deadline;
+static unsigned char cv_level, fast_frames;
+static unsigned int roi_center[2];
+
+// Row streaming accumulators
+static CvResult row_info;
+static Mask row_mask;
+static unsigned char row_level;
+static unsigned char roi[2];                    // First column and row
+static unsigned int col_sums[DS_IMAGE_COLS];
+static unsigned int rows_seen;
+static unsigned int bin_acc[DS_IMAGE_COLS/2];
+static unsigned char bin_row[DS_IMAGE_COLS/2];
+static unsigned long frame_mass, frame_pixels, x_moment, y_moment;
+
+// Circle pixel offsets as (column, row), clockwise from the top
+static const signed char fast_circle[FAST_CIRCLE_SIZE][2] = {
+    { 0, -3}, { 1, -3}, { 2, -2}, { 3, -1}, { 3,  0}, { 3,  1}, { 2,  2}, { 1,  3},
+    { 0,  3}, {-1,  3}, {-2,  2}, {-3,  1}, {-3,  0}, {-3, -1}, {-2, -2}, {-1, -3},
+};
+static unsigned int density_avg[CV_HAZARD_SECTORS]; // 8.8 fixed point
+static unsigned int ransac_seed;
+
 // =========== Function Stubs ==================================================
 
 // Shifting and setting helpers
@@ -66,6 +134,20 @@ static void shiftColumn(CamFrame frame, unsigned int col,
                     unsigned int row_dst, unsigned int row_src, unsigned int num);
 static void setColumn(CamFrame frame, unsigned int col, unsigned int row_dst,
                     unsigned char val, unsigned int num);
+
+// Beacon helpers
+static unsigned int detectBlobs(CamFrame frame, BlobDetectStruct *blobs);
+static void updateTrack(CvBlob track, BlobDetectStruct *blob);
+static void accumulateRow(unsigned int row, unsigned char *pixels,
+                    unsigned int first, unsigned int num, unsigned int step);
+static void updateLevel(unsigned long elapsed);
+static unsigned char median9(unsigned char *p);
+static unsigned int fastScore(CamFrame frame, unsigned int row,
+                    unsigned int col, unsigned char threshold);
+static unsigned int hasArc9(unsigned int mask);
+static void addCorner(unsigned int row, unsigned int col, unsigned int score);
+static unsigned int decodeBlinkCode(unsigned int history, unsigned int *id);
+static unsigned int searchBlinkId(DirEntry entry, void *args);
                     
 // =========== Public Methods ==================================================                    
                     
@@ -75,6 +157,20 @@ void cvSetup(void) {
        
     background_frame = NULL;
     high_pass_on = 0;
+    memset(tracks, 0, sizeof(tracks));
+    horizon_gain = 0.0;
+    denoise_mode = CV_DENOISE_OFF;
+    corner_threshold = 0;
+    num_corners = 0;
+    frame_deadline = 0;
+    cv_level = CV_LEVEL_FULL;
+    fast_frames = 0;
+    roi_center[0] = DS_IMAGE_COLS/2;
+    roi_center[1] = DS_IMAGE_ROWS/2;
+    memset(density_avg, 0, sizeof(density_avg));
+    ransac_seed = 1;
+    cvSetIntrinsics(CV_PIXELS_PER_RAD, (DS_IMAGE_COLS - 1)/2.0, 
+                    (DS_IMAGE_ROWS - 1)/2.0);
     
     is_ready = 1;
 
@@ -88,16 +184,40 @@ void cvSetHP() {
 
 void cvProcessFrame(CamFrame frame, CvResult info) {    
 
+    unsigned int i;
+    unsigned long start;
+
     if(!is_ready) { return; } // Module readiness quick fail       
 
+    start = sclockGetLocalTicks();
     cvReadFrameParams(frame, info);     
+    if(cv_level == CV_LEVEL_FULL && denoise_mode != CV_DENOISE_OFF) {
+        cvDenoise(frame, info, denoise_mode);
+    } else {
+        cvRowStart(info, NULL);
+        for(i = 0; i < DS_IMAGE_ROWS; i++) {
+            cvRowProcess(i, frame->pixels[i]);
+        }
+        cvRowFinish(info);
+    }
+    cvTrackBlobs(frame, info);
+    if(cv_level == CV_LEVEL_FULL && corner_threshold > 0) {
+        cvDetectCorners(frame, corner_threshold);
+    }
     //cvRotateFrame(frame, -attGetYawBAMS());
     
-    if(high_pass_on) {
+    if(high_pass_on && cv_level <= CV_LEVEL_HALF) {
         cvSobel(frame, info);
         //cvBinary(frame, info);
+        cvFindHorizon(frame, info);
+        cvDetectObstacles(frame, info);
+        if(horizon_gain > 0.0 && info->horizon_inliers > 0) {
+            tiltAddMeasurement(info->horizon[0], info->horizon[1],
+                                &info->pose, horizon_gain);
+        }
     }
-        
+
+    updateLevel(sclockGetLocalTicks() - start);
     
 }
 
@@ -114,6 +234,8 @@ CamFrame cvSetBackgroundFrame(CamFrame frame) {
 
 void cvReadFrameParams(CamFrame frame, CvResult info) {
 
+    CamParamStruct params;
+
     if(frame == NULL || info == NULL) { return; };
     
     memset(info, 0, sizeof(CvResultStruct)); // Reset fields
@@ -122,6 +244,37 @@ void cvReadFrameParams(CamFrame frame, CvResult info) {
     info->offset[1] = 0;       
     info->frame_num = frame->frame_num;    
 
+    // Frames are stamped in local time at readout start. Rows are exposed
+    // in turn over one frame period, so the middle row marks the midpoint.
+    camGetParams(&params);
+    info->timestamp = frame->timestamp + params.frame_period/2 
+                        + sclockGetOffsetTicks();
+    if(!phistGetQuat(info->timestamp, &info->pose)) {
+        gsampGetQuat(&info->pose);
+        tiltApply(&info->pose);
+    }
+
+}
+
+void cvReprojectCentroid(CvResult info, Quaternion *pose, int *pixel) {
+
+    Quaternion conj, delta;
+    float dy, dz;
+
+    // Rotation from current body frame to body frame at exposure
+    quatConj(pose, &conj);
+    quatMult(&conj, &info->pose, &delta);
+    if(delta.w < 0.0) {
+        delta.y = -delta.y;
+        delta.z = -delta.z;
+    }
+    dy = 2.0*delta.y;
+    dz = 2.0*delta.z;
+
+    // A fixed direction near +x moves by (0, dz, -dy) in the current frame
+    pixel[0] = (int)info->centroid[0] - (int)(dz*CV_PIXELS_PER_RAD);
+    pixel[1] = (int)info->centroid[1] + (int)(dy*CV_PIXELS_PER_RAD);
+
 }
 
 /**
@@ -250,6 +403,389 @@ void cvCentroidFrame(CamFrame frame, CvResult info) {
     temp = y_acc/info->mass;
     info->centroid[1] = (unsigned int) temp;
     
+    cvProjectPixel(info, info->centroid[0], info->centroid[1], info->bearing);
+
+}
+
+void cvSetIntrinsics(float focal, float center_col, float center_row) {
+
+    unsigned int i;
+
+    focal_length = focal;
+    center[0] = center_col;
+    center[1] = center_row;
+
+    for(i = 0; i < DS_IMAGE_COLS; i++) {
+        col_tan[i] = (i - center_col)/focal;
+    }
+    for(i = 0; i < DS_IMAGE_ROWS; i++) {
+        row_tan[i] = (i - center_row)/focal;
+    }
+
+}
+
+void cvPixelBearing(int col, int row, float *bearing) {
+
+    float tc, tr, norm;
+
+    // Pixels outside the image come from reprojection, compute directly
+    if(col >= 0 && col < DS_IMAGE_COLS) {
+        tc = col_tan[col];
+    } else {
+        tc = (col - center[0])/focal_length;
+    }
+    if(row >= 0 && row < DS_IMAGE_ROWS) {
+        tr = row_tan[row];
+    } else {
+        tr = (row - center[1])/focal_length;
+    }
+
+    norm = 1.0/sqrtf(1.0 + tc*tc + tr*tr);
+    bearing[0] = norm;
+    bearing[1] = -tc*norm;
+    bearing[2] = -tr*norm;
+
+}
+
+void cvProjectPixel(CvResult info, int col, int row, float *bearing) {
+
+    Quaternion vec, conj, temp;
+    float body[3];
+
+    cvPixelBearing(col, row, body);
+    vec.w = 0.0;
+    vec.x = body[0];
+    vec.y = body[1];
+    vec.z = body[2];
+
+    // Rotate from body frame at exposure into world frame
+    quatConj(&info->pose, &conj);
+    quatMult(&info->pose, &vec, &temp);
+    quatMult(&temp, &conj, &vec);
+
+    bearing[0] = vec.x;
+    bearing[1] = vec.y;
+    bearing[2] = vec.z;
+
+}
+
+void cvSetHorizonAiding(float gain) {
+
+    horizon_gain = gain;
+
+}
+
+void cvSetDenoise(unsigned char mode) {
+
+    denoise_mode = mode;
+
+}
+
+void cvSetCornerThreshold(unsigned char threshold) {
+
+    corner_threshold = threshold;
+
+}
+
+unsigned int cvDetectCorners(CamFrame frame, unsigned char threshold) {
+
+    unsigned int i, j, score;
+    unsigned int scores[3][DS_IMAGE_COLS];
+    unsigned int *above, *mid, *below;
+
+    num_corners = 0;
+    memset(scores, 0, sizeof(scores));
+
+    // Score one row ahead of the row being suppressed. The row past the
+    // last scored one is left at zero.
+    for(i = FAST_RADIUS; i <= DS_IMAGE_ROWS - FAST_RADIUS; i++) {
+
+        below = scores[i % 3];
+        memset(below, 0, sizeof(scores[0]));
+        if(i < DS_IMAGE_ROWS - FAST_RADIUS) {
+            for(j = FAST_RADIUS; j < DS_IMAGE_COLS - FAST_RADIUS; j++) {
+                below[j] = fastScore(frame, i, j, threshold);
+            }
+        }
+        if(i == FAST_RADIUS) { continue; }
+
+        mid = scores[(i + 2) % 3];
+        above = scores[(i + 1) % 3];
+        for(j = FAST_RADIUS; j < DS_IMAGE_COLS - FAST_RADIUS; j++) {
+            score = mid[j];
+            if(score == 0) { continue; }
+            // Ties go to the first corner in raster order
+            if(score <= above[j - 1] || score <= above[j] ||
+                score <= above[j + 1] || score <= mid[j - 1] ||
+                score < mid[j + 1] || score < below[j - 1] ||
+                score < below[j] || score < below[j + 1]) { continue; }
+            addCorner(i - 1, j, score);
+        }
+
+    }
+
+    return num_corners;
+
+}
+
+unsigned int cvGetCorners(CvCorner dst, unsigned int max) {
+
+    unsigned int num;
+
+    num = (num_corners < max) ? num_corners : max;
+    memcpy(dst, corners, num*sizeof(CvCornerStruct));
+    return num;
+
+}
+
+void cvSetFrameDeadline(unsigned long ticks) {
+
+    frame_deadline = ticks;
+    if(ticks == 0) { cv_level = CV_LEVEL_FULL; }
+    fast_frames = 0;
+
+}
+
+void cvRowStart(CvResult info, Mask mask) {
+
+    int start;
+
+    row_info = info;
+    row_mask = (cv_level == CV_LEVEL_FULL) ? mask : NULL;
+    row_level = cv_level;
+    frame_mass = 0;
+    frame_pixels = 0;
+    rows_seen = 0;
+    x_moment = 0;
+    y_moment = 0;
+    memset(col_sums, 0, sizeof(col_sums));
+    memset(info->histogram, 0, sizeof(info->histogram));
+    info->max_lum = 0;
+    info->level = row_level;
+    if(mask != NULL) { maskClear(mask); }
+
+    // Window around the last centroid, clipped to the frame
+    start = (int) roi_center[0] - CV_ROI_RADIUS;
+    if(start < 0) { start = 0; }
+    if(start > DS_IMAGE_COLS - 2*CV_ROI_RADIUS) { start = DS_IMAGE_COLS - 2*CV_ROI_RADIUS; }
+    roi[0] = start;
+    start = (int) roi_center[1] - CV_ROI_RADIUS;
+    if(start < 0) { start = 0; }
+    if(start > DS_IMAGE_ROWS - 2*CV_ROI_RADIUS) { start = DS_IMAGE_ROWS - 2*CV_ROI_RADIUS; }
+    roi[1] = start;
+
+}
+
+void cvRowProcess(unsigned int row, unsigned char *pixels) {
+
+    unsigned int j, k, step, sum;
+
+    if(row_level == CV_LEVEL_FULL) {
+        accumulateRow(row, pixels, 0, DS_IMAGE_COLS, 1);
+        if(row_mask != NULL) {
+            maskAddRow(row_mask, row, pixels, BIN_THRESHOLD);
+        }
+        return;
+    }
+
+    if(row_level == CV_LEVEL_ROI) {
+        if(row >= roi[1] && row < roi[1] + 2*CV_ROI_RADIUS) {
+            accumulateRow(row, pixels + roi[0], roi[0], 2*CV_ROI_RADIUS, 1);
+        }
+        return;
+    }
+
+    // Sum step x step blocks over consecutive rows
+    step = (row_level == CV_LEVEL_HALF) ? 2 : 4;
+    for(k = 0; k < DS_IMAGE_COLS/step; k++) {
+        sum = 0;
+        for(j = 0; j < step; j++) {
+            sum += pixels[k*step + j];
+        }
+        if(row % step == 0) { bin_acc[k] = sum; }
+        else { bin_acc[k] += sum; }
+    }
+    if(row % step == step - 1) {
+        for(k = 0; k < DS_IMAGE_COLS/step; k++) {
+            bin_row[k] = bin_acc[k]/(step*step);
+        }
+        accumulateRow(row + 1 - step, bin_row, 0, DS_IMAGE_COLS/step, step);
+    }
+
+}
+
+void cvRowFinish(CvResult info) {
+
+    unsigned int j, step;
+
+    step = 1;
+    if(row_level == CV_LEVEL_HALF) { step = 2; }
+    else if(row_level == CV_LEVEL_QUARTER) { step = 4; }
+
+    for(j = 0; j < DS_IMAGE_COLS; j++) {
+        if(rows_seen == 0) { break; }
+        if(j % step == 0) {
+            info->col_means[j] = (unsigned char) (col_sums[j]/rows_seen);
+        } else {
+            info->col_means[j] = info->col_means[j - 1];
+        }
+    }
+    info->mass = frame_mass;
+    info->avg_lum = (frame_pixels > 0) ? frame_mass/frame_pixels : 0;
+
+    // Moments are kept in half pixel units to center binned blocks
+    if(frame_mass == 0) {
+        info->centroid[0] = info->offset[0];
+        info->centroid[1] = info->offset[1];
+    } else {
+        info->centroid[0] = (unsigned int) (x_moment/(2*frame_mass));
+        info->centroid[1] = (unsigned int) (y_moment/(2*frame_mass));
+        roi_center[0] = info->centroid[0];
+        roi_center[1] = info->centroid[1];
+    }
+    cvProjectPixel(info, info->centroid[0], info->centroid[1], info->bearing);
+
+}
+
+void cvDenoise(CamFrame frame, CvResult info, unsigned char mode) {
+
+    unsigned int i, j;
+    unsigned char ring[3][DS_IMAGE_COLS];
+    unsigned char *above, *mid, *below, *out;
+    unsigned char window[9];
+    unsigned int col_sum[DS_IMAGE_COLS];
+
+    cvRowStart(info, NULL);
+
+    memcpy(ring[0], frame->pixels[0], DS_IMAGE_COLS);
+    above = ring[0];
+    mid = ring[0];
+
+    for(i = 0; i < DS_IMAGE_ROWS; i++) {
+
+        // Source rows are saved before being overwritten, edges repeat
+        if(i + 1 < DS_IMAGE_ROWS) {
+            below = ring[(i + 1) % 3];
+            memcpy(below, frame->pixels[i + 1], DS_IMAGE_COLS);
+        } else {
+            below = mid;
+        }
+
+        out = frame->pixels[i];
+        if(mode == CV_DENOISE_MEDIAN) {
+            for(j = 1; j < DS_IMAGE_COLS - 1; j++) {
+                window[0] = above[j - 1];
+                window[1] = above[j];
+                window[2] = above[j + 1];
+                window[3] = mid[j - 1];
+                window[4] = mid[j];
+                window[5] = mid[j + 1];
+                window[6] = below[j - 1];
+                window[7] = below[j];
+                window[8] = below[j + 1];
+                out[j] = median9(window);
+            }
+        } else if(mode == CV_DENOISE_BLUR) {
+            for(j = 0; j < DS_IMAGE_COLS; j++) {
+                col_sum[j] = above[j] + 2*mid[j] + below[j];
+            }
+            for(j = 1; j < DS_IMAGE_COLS - 1; j++) {
+                out[j] = (col_sum[j - 1] + 2*col_sum[j] + col_sum[j + 1] + 8) >> 4;
+            }
+        }
+
+        cvRowProcess(i, out);
+
+        above = mid;
+        mid = below;
+
+    }
+
+    cvRowFinish(info);
+
+}
+
+void cvTrackBlobs(CamFrame frame, CvResult info) {
+
+    BlobDetectStruct blobs[CV_MAX_BLOBS];
+    unsigned char matched[CV_MAX_BLOBS];
+    unsigned int i, j, num_blobs, best, dist, best_dist, id;
+    int col, row;
+    DirEntry entry;
+
+    num_blobs = detectBlobs(frame, blobs);
+    memset(matched, 0, sizeof(matched));
+
+    // Greedy nearest track association
+    for(i = 0; i < num_blobs; i++) {
+
+        col = blobs[i].sum_col/blobs[i].count;
+        row = blobs[i].sum_row/blobs[i].count;
+        best = CV_MAX_BLOBS;
+        best_dist = TRACK_RADIUS + 1;
+
+        for(j = 0; j < CV_MAX_BLOBS; j++) {
+            if(!tracks[j].valid || matched[j]) { continue; }
+            dist = abs(col - tracks[j].col) + abs(row - tracks[j].row);
+            if(dist < best_dist) {
+                best = j;
+                best_dist = dist;
+            }
+        }
+
+        // Start a new track in a free slot
+        if(best == CV_MAX_BLOBS) {
+            for(j = 0; j < CV_MAX_BLOBS; j++) {
+                if(!tracks[j].valid) { break; }
+            }
+            if(j == CV_MAX_BLOBS) { continue; }
+            best = j;
+            memset(&tracks[best], 0, sizeof(CvBlobStruct));
+            tracks[best].valid = 1;
+        }
+
+        matched[best] = 1;
+        updateTrack(&tracks[best], &blobs[i]);
+
+    }
+
+    // Once per strobe period, shift sightings into the code histories
+    if(info->frame_num % LSTROBE_FRAMES_PER_FLASH != LSTROBE_FRAMES_PER_FLASH - 1) {
+        return;
+    }
+
+    for(i = 0; i < CV_MAX_BLOBS; i++) {
+
+        if(!tracks[i].valid) { continue; }
+
+        tracks[i].history = (tracks[i].history << 1) | tracks[i].seen;
+        tracks[i].seen = 0;
+
+        if((tracks[i].history & TRACK_LOST_MASK) == 0) {
+            tracks[i].valid = 0;
+            continue;
+        }
+
+        if(decodeBlinkCode(tracks[i].history, &id) &&
+                dirQuery(&searchBlinkId, &id, &entry)) {
+            tracks[i].address = entry->address;
+        }
+
+    }
+
+}
+
+unsigned int cvGetBlobs(CvBlob blobs, unsigned int max) {
+
+    unsigned int i, num;
+
+    num = 0;
+    for(i = 0; i < CV_MAX_BLOBS && num < max; i++) {
+        if(tracks[i].valid) {
+            memcpy(&blobs[num++], &tracks[i], sizeof(CvBlobStruct));
+        }
+    }
+    return num;
 
 }
 
@@ -364,7 +900,118 @@ void cvSobel(CamFrame frame, CvResult info) {
     
 }
 
-#define BIN_THRESHOLD       (30)
+// One compare per pixel and a few operations per sector, well within a
+// frame period.
+void cvDetectObstacles(CamFrame frame, CvResult info) {
+
+    unsigned int i, j, s, width, density, mean;
+    long hazard;
+
+    for(s = 0; s < CV_HAZARD_SECTORS; s++) {
+
+        // Edge pixels per column of this sector, scaled to 0-255
+        density = 0;
+        width = 0;
+        for(j = s*SOBEL_IMAGE_COLS/CV_HAZARD_SECTORS;
+                j < (s + 1)*SOBEL_IMAGE_COLS/CV_HAZARD_SECTORS; j++) {
+            for(i = 0; i < SOBEL_IMAGE_ROWS; i++) {
+                if(frame->pixels[i][j] >= OBSTACLE_EDGE_THRESHOLD) { density++; }
+            }
+            width++;
+        }
+        density = (density*255)/(width*SOBEL_IMAGE_ROWS);
+
+        // Approaching surfaces fill their sector with texture
+        mean = density_avg[s] >> 8;
+        hazard = density + OBSTACLE_LOOM_GAIN*((long)density - (long)mean);
+        if(hazard < 0) { hazard = 0; }
+        if(hazard > 255) { hazard = 255; }
+        info->hazard[s] = (unsigned char) hazard;
+
+        density_avg[s] += (((long)density << 8) - (long)density_avg[s]) >> OBSTACLE_AVG_SHIFT;
+
+    }
+
+}
+
+void cvFindHorizon(CamFrame frame, CvResult info) {
+
+    unsigned char cols[SOBEL_IMAGE_COLS], rows[SOBEL_IMAGE_COLS];
+    unsigned int i, j, k, num_edges, inliers, best_inliers, max_val;
+    float slope, best_slope, best_row, dist, sc, sr, scc, scr, n, det;
+    float intercept, center_row;
+
+    info->horizon_inliers = 0;
+
+    // Strongest edge of each column
+    num_edges = 0;
+    for(j = 0; j < SOBEL_IMAGE_COLS; j++) {
+        max_val = 0;
+        for(i = 0; i < SOBEL_IMAGE_ROWS; i++) {
+            if(frame->pixels[i][j] > max_val) {
+                max_val = frame->pixels[i][j];
+                rows[num_edges] = i;
+            }
+        }
+        if(max_val >= HORIZON_EDGE_THRESHOLD) {
+            cols[num_edges++] = j;
+        }
+    }
+    if(num_edges < HORIZON_MIN_INLIERS) { return; }
+
+    // Line hypotheses through pairs of edges, row as a function of column
+    best_inliers = 0;
+    best_slope = 0.0;
+    best_row = 0.0;
+    for(k = 0; k < HORIZON_ITERATIONS; k++) {
+
+        ransac_seed = ransac_seed*25173 + 13849;
+        i = (ransac_seed >> 8) % num_edges;
+        ransac_seed = ransac_seed*25173 + 13849;
+        j = (ransac_seed >> 8) % num_edges;
+        if(cols[i] == cols[j]) { continue; }
+
+        slope = ((float)rows[j] - rows[i])/((float)cols[j] - cols[i]);
+        inliers = 0;
+        for(j = 0; j < num_edges; j++) {
+            dist = rows[j] - (rows[i] + slope*((float)cols[j] - cols[i]));
+            if(fabsf(dist) <= HORIZON_INLIER_DIST) { inliers++; }
+        }
+
+        if(inliers > best_inliers) {
+            best_inliers = inliers;
+            best_slope = slope;
+            best_row = rows[i] - slope*cols[i];
+        }
+
+    }
+    if(best_inliers < HORIZON_MIN_INLIERS) { return; }
+
+    // Least squares refit on the inliers
+    n = sc = sr = scc = scr = 0.0;
+    for(j = 0; j < num_edges; j++) {
+        dist = rows[j] - (best_row + best_slope*cols[j]);
+        if(fabsf(dist) > HORIZON_INLIER_DIST) { continue; }
+        n += 1.0;
+        sc += cols[j];
+        sr += rows[j];
+        scc += (float)cols[j]*cols[j];
+        scr += (float)cols[j]*rows[j];
+    }
+    det = n*scc - sc*sc;
+    if(det <= 0.0) { return; }
+    slope = (n*scr - sc*sr)/det;
+    intercept = (sr - slope*sc)/n;
+
+    // Sobel output is offset by one pixel from the source frame. The
+    // horizon tilts against the roll and drops in the image as the nose
+    // rises, which is negative pitch about body y.
+    center_row = intercept + 1.0 + slope*(center[0] - 1.0);
+    info->horizon[0] = -atanf(slope);
+    info->horizon[1] = atanf((center[1] - center_row)/focal_length);
+    info->horizon_inliers = best_inliers;
+
+}
 
 void cvBinary(CamFrame frame, CvResult info) {
 
@@ -384,8 +1031,253 @@ void cvBinary(CamFrame frame, CvResult info) {
 
 }
 
+unsigned int cvBinaryMask(CamFrame frame, Mask mask) {
+
+    return maskFromFrame(frame, BIN_THRESHOLD, mask);
+
+}
+
 // =========== Private Functions ===============================================
 
+// Clusters bright pixels in one raster pass. Rows are visited in order so a
+// pixel can only join a cluster reaching down to the previous rows.
+static unsigned int detectBlobs(CamFrame frame, BlobDetectStruct *blobs) {
+
+    unsigned int row, col, i, num_blobs;
+    BlobDetectStruct *blob;
+
+    num_blobs = 0;
+
+    for(row = 0; row < DS_IMAGE_ROWS; row++) {
+        for(col = 0; col < DS_IMAGE_COLS; col++) {
+
+            if(frame->pixels[row][col] < CV_BLOB_THRESHOLD) { continue; }
+
+            for(i = 0; i < num_blobs; i++) {
+                blob = &blobs[i];
+                if(row <= blob->max_row + BLOB_GAP &&
+                        col + BLOB_GAP >= blob->min_col &&
+                        col <= blob->max_col + BLOB_GAP) { break; }
+            }
+
+            if(i == num_blobs) {
+                if(num_blobs == CV_MAX_BLOBS) { continue; }
+                blob = &blobs[num_blobs++];
+                blob->sum_col = 0;
+                blob->sum_row = 0;
+                blob->count = 0;
+                blob->min_col = col;
+                blob->max_col = col;
+            }
+
+            blob->sum_col += col;
+            blob->sum_row += row;
+            blob->count++;
+            blob->max_row = row;
+            if(col < blob->min_col) { blob->min_col = col; }
+            if(col > blob->max_col) { blob->max_col = col; }
+
+        }
+    }
+
+    return num_blobs;
+
+}
+
+static void updateTrack(CvBlob track, BlobDetectStruct *blob) {
+
+    track->col = blob->sum_col/blob->count;
+    track->row = blob->sum_row/blob->count;
+    track->mass = blob->count;
+    track->seen = 1;
+
+}
+
+// Add a row of pixels, each standing for a step x step block whose top left
+// corner is at the given row and column first + k*step
+static void accumulateRow(unsigned int row, unsigned char *pixels,
+                    unsigned int first, unsigned int num, unsigned int step) {
+
+    unsigned int k, col, row_acc, weight;
+    unsigned long x_acc;
+    unsigned char val;
+
+    weight = step*step;
+    row_acc = 0;
+    x_acc = 0;
+    for(k = 0; k < num; k++) {
+        val = pixels[k];
+        col = first + k*step;
+        row_acc += val;
+        col_sums[col] += step*val;
+        x_acc += (unsigned long) (2*col + step - 1)*val;
+        row_info->histogram[val >> HIST_SHIFT] += weight;
+        if(val > row_info->max_lum) {
+            row_info->max_lum = val;
+            row_info->max[0] = col + step/2;
+            row_info->max[1] = row + step/2;
+        }
+    }
+
+    for(k = 0; k < step; k++) {
+        row_info->row_means[row + k] = (unsigned char) (row_acc/num);
+    }
+    rows_seen += step;
+    frame_mass += (unsigned long) weight*row_acc;
+    frame_pixels += (unsigned long) weight*num;
+    x_moment += weight*x_acc;
+    y_moment += (unsigned long) weight*(2*row + step - 1)*row_acc;
+
+}
+
+// Drop a level when over the deadline, raise it after a run of frames fast
+// enough to afford the 4 times larger pixel count
+static void updateLevel(unsigned long elapsed) {
+
+    if(frame_deadline == 0) { return; }
+
+    if(elapsed > frame_deadline) {
+        if(cv_level < CV_LEVEL_ROI) { cv_level++; }
+        fast_frames = 0;
+    } else if(4*elapsed < frame_deadline && cv_level > CV_LEVEL_FULL) {
+        if(++fast_frames >= LEVEL_HOLD_FRAMES) {
+            cv_level--;
+            fast_frames = 0;
+        }
+    } else {
+        fast_frames = 0;
+    }
+
+}
+
+// Branch free compare exchange, leaves min in a. Differences of 8 bit
+// pixels fit in 9 bits, so the shift yields an all ones mask when negative.
+#define MEDIAN_SORT(a, b)   { d = (a) - (b); m = d & (d >> 8); \
+                                t = (a); (a) = (b) + m; (b) = t - m; }
+
+// 19 exchange median network for 9 elements. Reorders p.
+static unsigned char median9(unsigned char *p) {
+
+    int d, m, t;
+
+    MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+    MEDIAN_SORT(p[0], p[1]); MEDIAN_SORT(p[3], p[4]); MEDIAN_SORT(p[6], p[7]);
+    MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+    MEDIAN_SORT(p[0], p[3]); MEDIAN_SORT(p[5], p[8]); MEDIAN_SORT(p[4], p[7]);
+    MEDIAN_SORT(p[3], p[6]); MEDIAN_SORT(p[1], p[4]); MEDIAN_SORT(p[2], p[5]);
+    MEDIAN_SORT(p[4], p[7]); MEDIAN_SORT(p[4], p[2]); MEDIAN_SORT(p[6], p[4]);
+    MEDIAN_SORT(p[4], p[2]);
+
+    return p[4];
+
+}
+
+// Sum of contrast beyond threshold over the brighter or darker circle
+// pixels, 0 if neither set holds a 9 pixel arc
+static unsigned int fastScore(CamFrame frame, unsigned int row,
+                    unsigned int col, unsigned char threshold) {
+
+    unsigned int k, bright, dark, bright_sum, dark_sum;
+    int high, low, val;
+
+    high = frame->pixels[row][col] + threshold;
+    low = frame->pixels[row][col] - threshold;
+
+    // Any 9 pixel arc covers at least 2 of the 4 compass pixels
+    bright = 0;
+    dark = 0;
+    for(k = 0; k < FAST_CIRCLE_SIZE; k += 4) {
+        val = frame->pixels[row + fast_circle[k][1]][col + fast_circle[k][0]];
+        if(val > high) { bright++; }
+        else if(val < low) { dark++; }
+    }
+    if(bright < 2 && dark < 2) { return 0; }
+
+    bright = 0;
+    dark = 0;
+    bright_sum = 0;
+    dark_sum = 0;
+    for(k = 0; k < FAST_CIRCLE_SIZE; k++) {
+        val = frame->pixels[row + fast_circle[k][1]][col + fast_circle[k][0]];
+        if(val > high) {
+            bright |= 1U << k;
+            bright_sum += val - high;
+        } else if(val < low) {
+            dark |= 1U << k;
+            dark_sum += low - val;
+        }
+    }
+
+    if(hasArc9(bright)) { return bright_sum; }
+    if(hasArc9(dark)) { return dark_sum; }
+    return 0;
+
+}
+
+// Checks a 16 bit circle mask for 9 consecutive set bits, wrapping around
+static unsigned int hasArc9(unsigned int mask) {
+
+    unsigned int k;
+    unsigned long run;
+
+    run = mask | ((unsigned long) mask << FAST_CIRCLE_SIZE);
+    for(k = 0; k < 8; k++) {
+        run &= run >> 1;
+    }
+    return (run & 0xFFFF) != 0;
+
+}
+
+// Keep the strongest corners, replacing the weakest when full
+static void addCorner(unsigned int row, unsigned int col, unsigned int score) {
+
+    unsigned int i, weakest;
+
+    if(num_corners < CV_MAX_CORNERS) {
+        weakest = num_corners++;
+    } else {
+        weakest = 0;
+        for(i = 1; i < CV_MAX_CORNERS; i++) {
+            if(corners[i].score < corners[weakest].score) { weakest = i; }
+        }
+        if(corners[weakest].score >= score) { return; }
+    }
+
+    corners[weakest].col = col;
+    corners[weakest].row = row;
+    corners[weakest].score = score;
+
+}
+
+// Returns 1 and the ID if the newest LSTROBE_CODE_LENGTH bits are a code word
+static unsigned int decodeBlinkCode(unsigned int history, unsigned int *id) {
+
+    unsigned int i, pair;
+
+    if((history >> (LSTROBE_CODE_LENGTH - LSTROBE_SYNC_BITS)) != LSTROBE_SYNC) {
+        return 0;
+    }
+
+    *id = 0;
+    for(i = 0; i < LSTROBE_ID_BITS; i++) {
+        pair = (history >> (2*i)) & 0x03;
+        if(pair == 0x02) {
+            *id |= 1 << i;
+        } else if(pair != 0x01) {
+            return 0;
+        }
+    }
+    return 1;
+
+}
+
+static unsigned int searchBlinkId(DirEntry entry, void *args) {
+
+    if(entry == NULL) { return 0; }
+    return (entry->address & LSTROBE_ID_MASK) == *((unsigned int*) args);
+
+}
+
 // Frame is pointer to CamFrame object
 // num is number of pixels top row (row 0) is shifted to the right
 static void shiftFrameHorizontal(CamFrame frame, int num) {
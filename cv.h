@@ -36,33 +36,95 @@
 * Revisions:
 *  Humphrey Hu      2011-07-01    Initial implementation
 *  Humphrey Hu      2012-02-16      Complete rewrite to use camera driver
+*
+* Notes:
+*  - Image columns increase towards body -y and rows towards body -z, so
+*    the image center looks along body +x.
 */
 
 #ifndef __CV_H
 #define __CV_H
 
 #include "cam.h"
+#include "quat.h"
+#include "bams.h"
+#include "mask.h"
+
+#define CV_PIXELS_PER_RAD       (46.0)  // 40 columns over a 50 degree field
+
+#define CV_MAX_BLOBS            (8)     // Beacons tracked at once
+#define CV_BLOB_THRESHOLD       (200)   // Minimum beacon pixel luminosity
+
+#define CV_HAZARD_SECTORS       (8)     // Column groups in obstacle cue
+#define CV_MAX_CORNERS          (16)    // Strongest corners kept per frame
+#define CV_HIST_BINS            (16)    // Luminosity histogram, 16 levels each
+#define CV_ROI_RADIUS           (8)     // Half width of the ROI window
+
+// Processing levels, from most to least detailed
+typedef enum {
+    CV_LEVEL_FULL = 0,          // Every pixel, all enabled stages
+    CV_LEVEL_HALF,              // 2x2 binned statistics, no denoise or corners
+    CV_LEVEL_QUARTER,           // 4x4 binned statistics only
+    CV_LEVEL_ROI,               // Statistics in a window around the last centroid
+} CvLevel;
+
+typedef enum {
+    CV_DENOISE_OFF = 0,
+    CV_DENOISE_MEDIAN,          // 3x3 median, removes hot pixels
+    CV_DENOISE_BLUR,            // 3x3 binomial, smooths sensor noise
+} CvDenoiseMode;
 
 // Frame calculation result storage class
 typedef struct {
     // Base info
     unsigned int frame_num;     // Corresponding frame number    
-    unsigned long timestamp;    // Time of processing
+    unsigned long timestamp;    // Global time of exposure midpoint
+    Quaternion pose;            // Attitude at exposure midpoint
     unsigned int offset[2];     // Location of center in camera frame 
+    unsigned char level;        // CvLevel the frame was processed at
     // Mass properties    
     unsigned long mass;         // Total luminosity
     unsigned char avg_lum;      // Average luminosity
     unsigned char row_means[DS_IMAGE_ROWS]; // Row means
     unsigned char col_means[DS_IMAGE_COLS]; // Column means        
+    unsigned int histogram[CV_HIST_BINS]; // Pixel counts by luminosity
     // Centroid finding   
     unsigned int centroid[2];   // Centroid location   
+    float bearing[3];           // World frame unit vector towards centroid
     // Max finding
     unsigned int max[2];        // Max pixel location
     unsigned char max_lum;      // Brightest pixel luminosity
+    // Horizon finding
+    float horizon[2];           // Roll and pitch implied by horizon line
+    unsigned char horizon_inliers; // Edges on horizon line, 0 if not found
+    // Obstacle cue, sectors ordered left to right in the image
+    unsigned char hazard[CV_HAZARD_SECTORS]; // 0 (clear) to 255 (blocked)
 } CvResultStruct;
 
 typedef CvResultStruct* CvResult;
 
+// Tracked strobe beacon
+typedef struct {
+    unsigned char col;          // Last seen centroid column
+    unsigned char row;          // Last seen centroid row
+    unsigned int mass;          // Bright pixels at last sighting
+    unsigned int history;       // One bit per strobe period, newest in LSB
+    unsigned int address;       // Decoded network address, 0 if unknown
+    unsigned char seen;         // Sighted during current strobe period
+    unsigned char valid;
+} CvBlobStruct;
+
+typedef CvBlobStruct* CvBlob;
+
+// FAST corner feature
+typedef struct {
+    unsigned char col;
+    unsigned char row;
+    unsigned int score;         // Summed contrast of the arc, 0 if none
+} CvCornerStruct;
+
+typedef CvCornerStruct* CvCorner;
+
 /**
  * Set up the CV module
  */
@@ -86,8 +148,52 @@ CamFrame cvSetBackgroundFrame(CamFrame frame);
  */
 void cvProcessFrame(CamFrame frame, CvResult info);
 
+/**
+ * Reset result fields and stamp the result with the frame's exposure
+ * midpoint and the attitude at that time
+ */
 void cvReadFrameParams(CamFrame frame, CvResult info);
 
+/**
+ * Centroid location as it would appear from the current pose. Uses a small
+ * angle approximation of the rotation since exposure.
+ *
+ * @param info - Processed frame result
+ * @param pose - Current attitude
+ * @param pixel - Destination column and row, may lie outside the image
+ */
+void cvReprojectCentroid(CvResult info, Quaternion *pose, int *pixel);
+
+/**
+ * Set pinhole camera intrinsics and rebuild the pixel angle tables
+ *
+ * @param focal - Focal length in pixels
+ * @param center_col - Column of the optical axis
+ * @param center_row - Row of the optical axis
+ */
+void cvSetIntrinsics(float focal, float center_col, float center_row);
+
+/**
+ * Body frame unit vector through a pixel
+ *
+ * @param col - Pixel column, may lie outside the image
+ * @param row - Pixel row, may lie outside the image
+ * @param bearing - Destination x, y, z
+ */
+void cvPixelBearing(int col, int row, float *bearing);
+
+/**
+ * World frame unit vector through a pixel, using the attitude at exposure.
+ * Yaw is this bird's own drifting estimate, so bearings from different
+ * birds do not share a heading.
+ *
+ * @param info - Frame result with pose filled in
+ * @param col - Pixel column
+ * @param row - Pixel row
+ * @param bearing - Destination x, y, z
+ */
+void cvProjectPixel(CvResult info, int col, int row, float *bearing);
+
 void cvCalculateMeans(CamFrame frame, CvResult info);
 
 void cvBackgroundSubtractFrame(CamFrame frame, CvResult info);
@@ -104,4 +210,139 @@ void cvHighPassPeak(CamFrame frame, CvResult info);
 
 void cvBinary(CamFrame frame, CvResult info);
 
+/**
+ * Threshold a frame like cvBinary() into a run length encoded mask,
+ * leaving the frame untouched
+ *
+ * @param frame - CamFrame to threshold
+ * @param mask - Destination mask
+ * @return Number of runs
+ */
+unsigned int cvBinaryMask(CamFrame frame, Mask mask);
+
+/**
+ * Fit the horizon line to a Sobel filtered frame. The strongest edge of
+ * each column forms a bounded edge list that is fitted by RANSAC.
+ *
+ * @param frame - CamFrame after cvSobel()
+ * @param info - Info struct to populate
+ */
+void cvFindHorizon(CamFrame frame, CvResult info);
+
+/**
+ * Rate each column sector of a Sobel filtered frame for obstacles from its
+ * edge density and the growth of that density since previous frames
+ * (looming). Call for consecutive frames.
+ *
+ * @param frame - CamFrame after cvSobel()
+ * @param info - Info struct to populate
+ */
+void cvDetectObstacles(CamFrame frame, CvResult info);
+
+/**
+ * Set the time allowed for cvProcessFrame(). The processing level drops
+ * after a frame runs over and rises again after several frames finish in
+ * under a quarter of the deadline.
+ *
+ * @param ticks - Deadline in system clock ticks, 0 always processes fully
+ */
+void cvSetFrameDeadline(unsigned long ticks);
+
+/**
+ * Begin accumulating row statistics for a frame. cvRowProcess() is shaped
+ * as a camera row hook so that the driver can feed rows while the frame is
+ * still being read out, leaving only cvRowFinish() after the last row.
+ *
+ * @param info - Info struct to populate, after cvReadFrameParams()
+ * @param mask - Mask to fill with cvBinary() thresholded runs, or NULL.
+ *  Only filled at CV_LEVEL_FULL.
+ */
+void cvRowStart(CvResult info, Mask mask);
+
+/**
+ * Accumulate means, histogram, brightest pixel, moments and threshold runs
+ * of one row. Rows must arrive in increasing order.
+ *
+ * @param row - Row number
+ * @param pixels - DS_IMAGE_COLS pixels of the row
+ */
+void cvRowProcess(unsigned int row, unsigned char *pixels);
+
+/**
+ * Complete column means, mass, centroid and bearing of the current frame
+ *
+ * @param info - Info struct passed to cvRowStart()
+ */
+void cvRowFinish(CvResult info);
+
+/**
+ * Select the filter applied to frames ahead of all other processing
+ *
+ * @param mode - CvDenoiseMode
+ */
+void cvSetDenoise(unsigned char mode);
+
+/**
+ * Filter a frame in place while passing finished rows to cvRowProcess().
+ * Only a 3 row ring of source pixels is buffered. Border pixels are not
+ * filtered.
+ *
+ * @param frame - CamFrame to filter
+ * @param info - Info struct to populate
+ * @param mode - CvDenoiseMode
+ */
+void cvDenoise(CamFrame frame, CvResult info, unsigned char mode);
+
+/**
+ * Feed horizon roll and pitch to attitude tilt correction
+ *
+ * @param gain - Fraction of tilt error removed per frame, 0 disables
+ */
+void cvSetHorizonAiding(float gain);
+
+/**
+ * Detect bright beacons, associate them with tracks from earlier frames and
+ * decode their blink codes. Call once for every consecutive frame.
+ *
+ * @param frame - CamFrame to process
+ * @param info - Result with frame number filled in
+ */
+void cvTrackBlobs(CamFrame frame, CvResult info);
+
+/**
+ * Copy out current beacon tracks
+ *
+ * @param blobs - Destination array
+ * @param max - Size of destination array
+ * @return Number of tracks copied
+ */
+unsigned int cvGetBlobs(CvBlob blobs, unsigned int max);
+
+/**
+ * Set the FAST corner contrast threshold used by cvProcessFrame()
+ *
+ * @param threshold - Minimum pixel contrast, 0 disables corner detection
+ */
+void cvSetCornerThreshold(unsigned char threshold);
+
+/**
+ * Find FAST-9 corners, pixels with an arc of 9 out of 16 circle pixels all
+ * brighter or all darker than the center by threshold. Non-maximal corners
+ * are suppressed and at most CV_MAX_CORNERS of the strongest are kept.
+ *
+ * @param frame - Unfiltered or denoised CamFrame
+ * @param threshold - Minimum pixel contrast
+ * @return Number of corners kept
+ */
+unsigned int cvDetectCorners(CamFrame frame, unsigned char threshold);
+
+/**
+ * Copy out corners of the last processed frame
+ *
+ * @param corners - Destination array
+ * @param max - Size of destination array
+ * @return Number of corners copied
+ */
+unsigned int cvGetCorners(CvCorner corners, unsigned int max);
+
 #endif
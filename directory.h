@@ -57,7 +57,7 @@ typedef struct {
     unsigned int padding : 10;
 } DirEndpointParam;
 
- typedef struct {    // (28)
+ typedef struct {    // (52)
  
     unsigned long long uuid;    // Endpoint identifier number (8)
     DirEndpointType type;       // Type of endpoint (2)
@@ -69,6 +69,21 @@ typedef struct {
     unsigned long timestamp;    // Last time of contact in local time (4)
     unsigned int address;       // 16-bit radio address (2)
     unsigned int pan_id;        // Radio PAN ID (2)
+
+    unsigned int rssi;          // RSSI moving average, 8.8 fixed point (2)
+    unsigned int ed;            // ED moving average, 8.8 fixed point (2)
+    unsigned int loss;          // Loss rate moving average, 0.16 fixed point (2)
+    unsigned int rx_count;      // Packets received (2)
+    unsigned int advert_count;  // Route adverts received (2)
+    unsigned int lost_count;    // Adverts missed according to sequence gaps (2)
+    unsigned char last_seq;     // Last received advert sequence number (1)
+    unsigned char quality;      // Link quality, 0 (dead) to 255 (perfect) (1)
+
+    unsigned long route_time;   // Last route refresh in local time (4)
+    unsigned int next_hop;      // Mesh next hop address (2)
+    unsigned int route_cost;    // Mesh path cost, 256 per perfect hop (2)
+    unsigned char hops;         // Mesh path length, 0 if no route (1)
+    unsigned char route_flags;  // Reserved (1)
     
  } DirEntryStruct;
  
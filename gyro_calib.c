@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Temperature Indexed Gyro Calibration
+ *
+ * v.beta
+ */
+
+#include "gyro_calib.h"
+#include "gyro_sampler.h"
+#include "gyro.h"
+#include "dfmem.h"
+#include "telemetry.h"
+#include "sensor_dump.h"
+#include "journal.h"
+#include "sys_clock.h"
+#include "timer.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define TABLE_MAGIC             (0x6CA1)
+#define TEMP_MERGE              (2.0)       // Replace entries this close, deg C
+#define UPDATE_PERIOD           (625000)    // 1 s between temperature checks
+#define FLASH_BUFFER            (1)
+
+typedef struct {
+    float temp;             // Deg C
+    float offset[3];        // rad/s
+} GcalEntryStruct;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int num;
+    GcalEntryStruct entries[GCAL_TABLE_SIZE];
+    unsigned int checksum;
+} GcalTableStruct;
+
+typedef enum {
+    GCAL_IDLE = 0,
+    GCAL_SAMPLING,
+    GCAL_DONE,
+    GCAL_SAVING,
+} GcalState;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static GcalTableStruct table;
+static float offset[3];
+static unsigned long next_update;
+
+// Calibration job, accumulated by the control interrupt
+static volatile GcalState state;
+static volatile unsigned int target, count;
+static volatile float rate_sum[3];
+static float start_temp;
+
+// =========== Function Stubs ==================================================
+static unsigned int tableChecksum(void);
+static void tableInsert(float temp, float *values);
+static void tableInterpolate(float temp, float *values);
+static void applyOffset(float *values);
+static unsigned int flashBusy(void);
+
+// =========== Public Functions ================================================
+
+void gcalSetup(void) {
+
+    state = GCAL_IDLE;
+    memset(offset, 0, sizeof(offset));
+
+    dfmemRead(GCAL_PAGE, 0, sizeof(GcalTableStruct), (unsigned char*) &table);
+    if(table.magic != TABLE_MAGIC || table.num > GCAL_TABLE_SIZE ||
+        table.checksum != tableChecksum()) {
+        memset(&table, 0, sizeof(GcalTableStruct));
+        table.magic = TABLE_MAGIC;
+    }
+
+    next_update = sclockGetLocalTicks();
+    is_ready = 1;
+
+}
+
+unsigned int gcalStart(unsigned int samples) {
+
+    if(!is_ready || state != GCAL_IDLE || samples == 0) { return 0; }
+    if(flashBusy()) { return 0; }
+
+    start_temp = gsampReadTemp();
+    memset((void*) rate_sum, 0, sizeof(rate_sum));
+    count = 0;
+    target = samples;
+    state = GCAL_SAMPLING;
+    return 1;
+
+}
+
+unsigned int gcalIsRunning(void) {
+
+    return state != GCAL_IDLE;
+
+}
+
+void gcalSample(void) {
+
+    float rate[3];
+
+    if(state != GCAL_SAMPLING) { return; }
+
+    gyroGetRadXYZ(rate);
+    rate_sum[0] += rate[0];
+    rate_sum[1] += rate[1];
+    rate_sum[2] += rate[2];
+    if(++count >= target) { state = GCAL_DONE; }
+
+}
+
+void gcalProcess(void) {
+
+    unsigned long now;
+    float values[3], temp;
+
+    if(!is_ready) { return; }
+
+    if(state == GCAL_DONE) {
+        temp = 0.5*(start_temp + gsampReadTemp());
+        values[0] = rate_sum[0]/count;
+        values[1] = rate_sum[1]/count;
+        values[2] = rate_sum[2]/count;
+        tableInsert(temp, values);
+        table.checksum = tableChecksum();
+        applyOffset(values);
+        state = GCAL_SAVING;
+    }
+
+    // Recorders alternate between both flash buffers, so wait them out
+    if(state == GCAL_SAVING) {
+        if(flashBusy()) { return; }
+        dfmemWrite((unsigned char*) &table, sizeof(GcalTableStruct),
+                    GCAL_PAGE, 0, FLASH_BUFFER);
+        state = GCAL_IDLE;
+        return;
+    }
+
+    now = sclockGetLocalTicks();
+    if(state != GCAL_IDLE || (long)(now - next_update) < 0) { return; }
+    next_update = now + UPDATE_PERIOD;
+
+    if(table.num == 0) { return; }
+    tableInterpolate(gsampReadTemp(), values);
+    applyOffset(values);
+
+}
+
+void gcalGetOffset(float *dst) {
+
+    memcpy(dst, offset, sizeof(offset));
+
+}
+
+// =========== Private Functions ===============================================
+
+static unsigned int flashBusy(void) {
+
+    return telemIsLogging() || sdumpIsRecording() || jrnlIsRecording();
+
+}
+
+static unsigned int tableChecksum(void) {
+
+    unsigned int i, sum, *words;
+
+    words = (unsigned int*) &table;
+    sum = 0;
+    for(i = 0; i < offsetof(GcalTableStruct, checksum)/sizeof(unsigned int); i++) {
+        sum += words[i];
+    }
+    return sum;
+
+}
+
+// Keep entries sorted by temperature. Nearby entries are replaced, and the
+// closest entry is replaced when the table is full.
+static void tableInsert(float temp, float *values) {
+
+    unsigned int i, pos;
+    float dist, best;
+
+    pos = table.num;
+    best = 0.0;
+    for(i = 0; i < table.num; i++) {
+        dist = table.entries[i].temp - temp;
+        if(dist < 0.0) { dist = -dist; }
+        if(dist < TEMP_MERGE || (table.num == GCAL_TABLE_SIZE &&
+            (pos == table.num || dist < best))) {
+            pos = i;
+            best = dist;
+        }
+    }
+
+    if(pos < table.num) {
+        // Remove the replaced entry, then insert in order below
+        memmove(&table.entries[pos], &table.entries[pos + 1],
+                (table.num - pos - 1)*sizeof(GcalEntryStruct));
+        table.num--;
+    }
+
+    for(pos = 0; pos < table.num && table.entries[pos].temp < temp; pos++);
+    memmove(&table.entries[pos + 1], &table.entries[pos],
+            (table.num - pos)*sizeof(GcalEntryStruct));
+    table.entries[pos].temp = temp;
+    memcpy(table.entries[pos].offset, values, 3*sizeof(float));
+    table.num++;
+
+}
+
+// Linear between neighbouring entries, constant beyond the ends
+static void tableInterpolate(float temp, float *values) {
+
+    unsigned int i, j;
+    float frac;
+    GcalEntryStruct *low, *high;
+
+    if(temp <= table.entries[0].temp) {
+        memcpy(values, table.entries[0].offset, 3*sizeof(float));
+        return;
+    }
+    for(i = 1; i < table.num; i++) {
+        if(temp < table.entries[i].temp) { break; }
+    }
+    if(i == table.num) {
+        memcpy(values, table.entries[i - 1].offset, 3*sizeof(float));
+        return;
+    }
+
+    low = &table.entries[i - 1];
+    high = &table.entries[i];
+    frac = (temp - low->temp)/(high->temp - low->temp);
+    for(j = 0; j < 3; j++) {
+        values[j] = low->offset[j] + frac*(high->offset[j] - low->offset[j]);
+    }
+
+}
+
+static void applyOffset(float *values) {
+
+    memcpy(offset, values, sizeof(offset));
+    gsampSetGyroOffset(offset);
+
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Temperature Indexed Gyro Calibration
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - gcalStart() begins a calibration job. gcalSample() averages gyro rates
+ *    from the control interrupt while the robot is held still, and
+ *    gcalProcess() files the result in the background.
+ *  - Offsets are kept in a table sorted by temperature and stored in flash
+ *    page GCAL_PAGE. It lies in the first flash sector, outside the
+ *    telemetry log region, so it survives resets and log erases.
+ *  - At runtime the offsets are interpolated at the current gyro
+ *    temperature and handed to the gyro sampler. The gyro driver's own
+ *    calibration is left at zero.
+ *  - Saving the table goes through a flash buffer that telemetry logging,
+ *    sensor dumps and the journal also use. Calibration is refused while
+ *    any of them records, and a finished table is held until they stop.
+ */
+
+#ifndef __GYRO_CALIB_H
+#define __GYRO_CALIB_H
+
+#define GCAL_TABLE_SIZE         (8)
+#define GCAL_PAGE               (0x04)
+
+/**
+ * Load the calibration table from flash and apply it
+ */
+void gcalSetup(void);
+
+/**
+ * Begin a calibration job
+ * @param count - Number of control ticks to average
+ * @return 1 if started, 0 if a job is already running or flash is in use
+ */
+unsigned int gcalStart(unsigned int count);
+
+/**
+ * Returns 1 while a calibration job is running
+ */
+unsigned int gcalIsRunning(void);
+
+/**
+ * Accumulate a calibration sample. Call from the control interrupt.
+ */
+void gcalSample(void);
+
+/**
+ * Finish calibration jobs and track temperature. Call regularly from the
+ * background.
+ */
+void gcalProcess(void);
+
+/**
+ * Offsets currently applied
+ * @param offset - Destination for x, y, z offsets in rad/s
+ */
+void gcalGetOffset(float *offset);
+
+#endif // __GYRO_CALIB_H
@@ -0,0 +1,360 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Oversampled Gyro Integration
+ *
+ * v.beta
+ */
+
+#include "gyro_sampler.h"
+#include "gyro.h"
+#include "xl.h"
+#include "sensor_dump.h"
+#include "journal.h"
+#include "attitude.h"
+#include "timer.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FCY                     (40000000)  // 40 MIPS
+
+#define DEFAULT_KP              (0.5)
+#define DEFAULT_KI              (0.02)
+#define XL_NORM_TOLERANCE       (0.2)   // Fraction of 1 g
+#define XL_NORM_FILTER          (0.01)  // Learning rate of the 1 g norm
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0, is_running = 0;
+static float sample_period;
+static Quaternion pose;
+
+// Written by the sampling interrupt, swapped out by gsampUpdate()
+static volatile float alpha_sum[3], coning[3];
+
+// Accelerometer sums, swapped out by gsampCorrect()
+static volatile float xl_sum[3];
+static volatile unsigned int xl_count, xl_decimate;
+
+// Mahony correction state, bias is read by the sampling interrupt
+static float kp, ki, gravity_norm;
+static volatile float bias[3];
+
+// Calibration offset, read by the sampling interrupt. New offsets wait
+// for the next control tick so they land at a journaled point.
+static volatile float offset[3];
+static float pending_offset[3];
+static unsigned char offset_pending;
+
+// =========== Function Stubs ==================================================
+static void setupTimer7(unsigned int fs);
+
+// =========== Public Functions ================================================
+
+void gsampSetup(unsigned int rate) {
+
+    sample_period = 1.0/rate;
+    memset((void*) alpha_sum, 0, sizeof(alpha_sum));
+    memset((void*) coning, 0, sizeof(coning));
+    pose.w = 1.0;
+    pose.x = 0.0;
+    pose.y = 0.0;
+    pose.z = 0.0;
+    memset((void*) xl_sum, 0, sizeof(xl_sum));
+    memset((void*) bias, 0, sizeof(bias));
+    memset((void*) offset, 0, sizeof(offset));
+    offset_pending = 0;
+    xl_count = 0;
+    xl_decimate = 0;
+    kp = DEFAULT_KP;
+    ki = DEFAULT_KI;
+    gravity_norm = 0.0;
+    setupTimer7(rate);
+    is_ready = 1;
+
+}
+
+void gsampStart(void) {
+
+    if(!is_ready) { return; }
+
+    attGetQuat(&pose);
+    memset((void*) alpha_sum, 0, sizeof(alpha_sum));
+    memset((void*) coning, 0, sizeof(coning));
+    is_running = 1;
+    EnableIntT7;
+
+}
+
+void gsampStop(void) {
+
+    DisableIntT7;
+    is_running = 0;
+
+}
+
+unsigned char gsampIsRunning(void) {
+
+    return is_running;
+
+}
+
+void gsampReset(void) {
+
+    DisableIntT5;
+    DisableIntT7;
+    attGetQuat(&pose);
+    memset((void*) alpha_sum, 0, sizeof(alpha_sum));
+    memset((void*) coning, 0, sizeof(coning));
+    if(is_running) { EnableIntT7; }
+    EnableIntT5;
+
+}
+
+void gsampUpdate(void) {
+
+    Quaternion delta, temp;
+    float phi[3], angle, scale;
+
+    if(!is_running) { return; }
+
+    DisableIntT7;
+    phi[0] = alpha_sum[0] + coning[0];
+    phi[1] = alpha_sum[1] + coning[1];
+    phi[2] = alpha_sum[2] + coning[2];
+    memset((void*) alpha_sum, 0, sizeof(alpha_sum));
+    memset((void*) coning, 0, sizeof(coning));
+    if(offset_pending) {
+        memcpy((void*) offset, pending_offset, sizeof(pending_offset));
+        offset_pending = 0;
+        jrnlOffset(pending_offset);
+    }
+    EnableIntT7;
+
+    // Rotation vector to body frame delta quaternion
+    angle = sqrtf(phi[0]*phi[0] + phi[1]*phi[1] + phi[2]*phi[2]);
+    if(angle > 1e-6) {
+        scale = sinf(0.5*angle)/angle;
+    } else {
+        scale = 0.5;
+    }
+    delta.w = cosf(0.5*angle);
+    delta.x = scale*phi[0];
+    delta.y = scale*phi[1];
+    delta.z = scale*phi[2];
+
+    quatMult(&pose, &delta, &temp);
+    quatNormalize(&temp);
+    quatCopy(&pose, &temp);
+
+}
+
+void gsampSetCorrectionGains(float p, float i) {
+
+    kp = p;
+    ki = i;
+
+}
+
+void gsampCorrect(void) {
+
+    Quaternion conj, up, temp, delta, updated;
+    float xl[3], err[3], norm, dt;
+    unsigned int count;
+
+    if(!is_running || xl_count < GSAMP_XL_AVERAGE) { return; }
+
+    DisableIntT7;
+    xl[0] = xl_sum[0];
+    xl[1] = xl_sum[1];
+    xl[2] = xl_sum[2];
+    count = xl_count;
+    memset((void*) xl_sum, 0, sizeof(xl_sum));
+    xl_count = 0;
+    EnableIntT7;
+
+    if(kp <= 0.0) { return; }
+
+    norm = sqrtf(xl[0]*xl[0] + xl[1]*xl[1] + xl[2]*xl[2])/count;
+    if(norm <= 0.0) { return; }
+    if(gravity_norm == 0.0) { gravity_norm = norm; }
+    if(fabsf(norm - gravity_norm) > XL_NORM_TOLERANCE*gravity_norm) { return; }
+    gravity_norm += XL_NORM_FILTER*(norm - gravity_norm);
+
+    norm = norm*count;
+    xl[0] /= norm;
+    xl[1] /= norm;
+    xl[2] /= norm;
+
+    // World up in the body frame as currently estimated
+    quatCopy(&temp, &pose);
+    up.w = 0.0;
+    up.x = 0.0;
+    up.y = 0.0;
+    up.z = 1.0;
+    quatConj(&temp, &conj);
+    quatMult(&conj, &up, &delta);
+    quatMult(&delta, &temp, &up);
+
+    err[0] = xl[1]*up.z - xl[2]*up.y;
+    err[1] = xl[2]*up.x - xl[0]*up.z;
+    err[2] = xl[0]*up.y - xl[1]*up.x;
+
+    dt = count*GSAMP_XL_DECIMATION*sample_period;
+    delta.w = 1.0;
+    delta.x = 0.5*kp*err[0]*dt;
+    delta.y = 0.5*kp*err[1]*dt;
+    delta.z = 0.5*kp*err[2]*dt;
+
+    quatMult(&pose, &delta, &updated);
+    quatNormalize(&updated);
+    quatCopy(&pose, &updated);
+    DisableIntT7;
+    bias[0] -= ki*err[0]*dt;
+    bias[1] -= ki*err[1]*dt;
+    bias[2] -= ki*err[2]*dt;
+    EnableIntT7;
+
+}
+
+void gsampSetGyroOffset(float *src) {
+
+    DisableIntT5;
+    memcpy(pending_offset, src, sizeof(pending_offset));
+    offset_pending = 1;
+    EnableIntT5;
+
+}
+
+float gsampReadTemp(void) {
+
+    float temp;
+
+    // The control interrupt reads the gyro itself when not sampling
+    DisableIntT5;
+    DisableIntT7;
+    temp = gyroGetFloatTemp();
+    if(is_running) { EnableIntT7; }
+    EnableIntT5;
+    jrnlTemp(temp);
+    return temp;
+
+}
+
+void gsampGetBias(float *dst) {
+
+    DisableIntT7;
+    dst[0] = bias[0];
+    dst[1] = bias[1];
+    dst[2] = bias[2];
+    if(is_running) { EnableIntT7; }
+
+}
+
+void gsampGetQuat(Quaternion *dst) {
+
+    if(!is_running) {
+        attGetQuat(dst);
+        return;
+    }
+
+    // Written by the control interrupt
+    DisableIntT5;
+    quatCopy(dst, &pose);
+    EnableIntT5;
+
+}
+
+// =========== Private Functions ===============================================
+
+/**
+ * Interrupt handler for Timer 7
+ * Integrates one gyro sample with coning compensation and sums decimated
+ * accelerometer readings. While recording, the accelerometer is read every
+ * sample and both raw readings are handed to the recorder.
+ */
+void __attribute__((interrupt, no_auto_psv)) _T7Interrupt(void) {
+
+    float rate[3], alpha[3];
+    unsigned char recording;
+
+    gyroReadXYZ();
+    jrnlGyro();
+    recording = sdumpIsRecording();
+    if(recording) { xlReadXYZ(); }
+    gyroGetRadXYZ(rate);
+
+    alpha[0] = (rate[0] - offset[0] - bias[0])*sample_period;
+    alpha[1] = (rate[1] - offset[1] - bias[1])*sample_period;
+    alpha[2] = (rate[2] - offset[2] - bias[2])*sample_period;
+
+    // Coning from the rotation so far crossed with the new increment
+    coning[0] += 0.5*(alpha_sum[1]*alpha[2] - alpha_sum[2]*alpha[1]);
+    coning[1] += 0.5*(alpha_sum[2]*alpha[0] - alpha_sum[0]*alpha[2]);
+    coning[2] += 0.5*(alpha_sum[0]*alpha[1] - alpha_sum[1]*alpha[0]);
+
+    alpha_sum[0] += alpha[0];
+    alpha_sum[1] += alpha[1];
+    alpha_sum[2] += alpha[2];
+
+    if(++xl_decimate >= GSAMP_XL_DECIMATION) {
+        xl_decimate = 0;
+        if(!recording) { xlReadXYZ(); }
+        jrnlXl();
+        xlGetFloatXYZ(rate);
+        xl_sum[0] += rate[0];
+        xl_sum[1] += rate[1];
+        xl_sum[2] += rate[2];
+        xl_count++;
+    }
+
+    if(recording) { sdumpSample(); }
+
+    _T7IF = 0;
+
+}
+
+static void setupTimer7(unsigned int fs) {
+
+    unsigned int con_reg, period;
+
+    con_reg =   T7_ON &         // Timer on
+                T7_IDLE_STOP &  // Stop timer when idle
+                T7_GATE_OFF &   // Gated mode off
+                T7_PS_1_8 &     // Prescale 1:8
+                T7_SOURCE_INT;  // Internal clock source
+
+    // period value = Fcy/(prescale*Ftimer)
+    period = FCY/(8*fs);
+
+    OpenTimer7(con_reg, period);
+    ConfigIntTimer7(T7_INT_PRIOR_5 & T7_INT_OFF);
+
+}
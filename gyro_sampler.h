@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Oversampled Gyro Integration
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Timer 7 samples the gyro several times per control period. Each sample
+ *    is integrated into a rotation vector together with the coning term
+ *    0.5*sum(alpha_sum x alpha_k), so rotation about a wobbling axis is not
+ *    lost between control ticks.
+ *  - gsampUpdate() is called once per control tick from the Timer 5
+ *    interrupt. It applies the accumulated increment to its own attitude
+ *    quaternion as a single delta quaternion.
+ *  - While running, the sampler owns the I2C sensor bus. Other interrupts
+ *    must not read the gyro or accelerometer.
+ *  - The accelerometer is read every GSAMP_XL_DECIMATION'th sample. Once
+ *    GSAMP_XL_AVERAGE reads have been summed, gsampCorrect() runs a Mahony
+ *    step on the next control tick: the cross product of measured and
+ *    predicted gravity rotates the attitude proportionally and integrates
+ *    into the gyro bias. Running on the tick keeps the result a function of
+ *    the journaled sensor readings alone.
+ *  - Gyro offsets set from the background take effect at the next control
+ *    tick and are journaled there.
+ *  - Readings whose magnitude strays from the learned 1 g norm are rejected
+ *    as maneuvering. Accelerometer axes are assumed aligned with the body.
+ *  - While the sensor recorder runs, the accelerometer is read on every
+ *    sample.
+ *  - A fixed calibration offset may be set with gsampSetGyroOffset(). It is
+ *    subtracted ahead of the learned bias.
+ */
+
+#ifndef __GYRO_SAMPLER_H
+#define __GYRO_SAMPLER_H
+
+#include "quat.h"
+
+#define GSAMP_XL_DECIMATION     (12)    // 100 Hz at 1200 Hz sampling
+#define GSAMP_XL_AVERAGE        (4)     // Reads per correction step
+
+/**
+ * Configure the sampling timer. Sampling starts with gsampStart().
+ * @param rate - Samples per second
+ */
+void gsampSetup(unsigned int rate);
+
+/**
+ * Start sampling from the current attitude estimate. Call before the
+ * control interrupt is enabled.
+ */
+void gsampStart(void);
+
+/**
+ * Stop sampling. The gyro may be read elsewhere afterwards.
+ */
+void gsampStop(void);
+
+/**
+ * Returns 1 if sampling, 0 otherwise
+ */
+unsigned char gsampIsRunning(void);
+
+/**
+ * Restart integration from the current attitude estimate. Call from the
+ * background only.
+ */
+void gsampReset(void);
+
+/**
+ * Integrate the samples taken since the last call. Call once per control
+ * tick from the control interrupt.
+ */
+void gsampUpdate(void);
+
+/**
+ * Set accelerometer correction gains
+ * @param kp - Proportional gain in rad/s per unit gravity error, 0 disables
+ * @param ki - Bias integral gain in rad/s^2 per unit gravity error
+ */
+void gsampSetCorrectionGains(float kp, float ki);
+
+/**
+ * Run an accelerometer correction step if enough readings are available.
+ * Call from the Timer 5 interrupt after gsampUpdate().
+ */
+void gsampCorrect(void);
+
+/**
+ * Set the fixed gyro offset, typically from temperature calibration.
+ * Applied at the next gsampUpdate().
+ * @param offset - x, y, z offsets in rad/s
+ */
+void gsampSetGyroOffset(float *offset);
+
+/**
+ * Read the gyro temperature without disturbing the sampler. Call from the
+ * background only.
+ * @return Temperature in degrees C
+ */
+float gsampReadTemp(void);
+
+/**
+ * Current gyro bias estimate
+ * @param bias - Destination for x, y, z bias in rad/s
+ */
+void gsampGetBias(float *bias);
+
+/**
+ * Current attitude estimate, integrated here while sampling and taken from
+ * the attitude module otherwise. All attitude readers should use this.
+ * @param pose - Destination quaternion
+ */
+void gsampGetQuat(Quaternion *pose);
+
+#endif // __GYRO_SAMPLER_H
@@ -0,0 +1,329 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Input Journal for Flight Replay
+ *
+ * v.beta
+ */
+
+#include "journal.h"
+#include "gyro_sampler.h"
+#include "gyro.h"
+#include "xl.h"
+#include "dfmem.h"
+#include "payload.h"
+#include "sys_clock.h"
+#include "timer.h"
+
+#include <string.h>
+
+#define RECORD_HEADER           (3)
+#define MAX_RADIO_DATA          (120)   // Longer payloads are truncated
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static volatile unsigned char is_recording = 0;
+
+static JournalPageStruct pages[JRNL_NUM_BUFFERS];
+static DfmemGeometryStruct mem_geo;
+static unsigned int mem_page_pos, mem_buff_index;
+
+// Buffer ring, filled at head and written at tail
+static volatile unsigned int head, tail, num_full;
+static volatile unsigned char filling;
+static unsigned int seq, dropped;
+static unsigned long last_time;
+
+// =========== Function Stubs ==================================================
+static void record(unsigned char type, unsigned char *data, unsigned int len);
+static unsigned int append(unsigned char type, unsigned long now,
+                        unsigned char *data, unsigned int len);
+static void finishPage(void);
+
+// =========== Public Functions ================================================
+
+void jrnlSetup(void) {
+
+    dfmemGetGeometryParams(&mem_geo);
+    is_recording = 0;
+    is_ready = 1;
+
+}
+
+unsigned int jrnlStart(void) {
+
+    unsigned int i;
+
+    if(!is_ready || is_recording) { return 0; }
+    if(mem_geo.bytes_per_page < sizeof(JournalPageStruct)) { return 0; }
+
+    mem_page_pos = JRNL_START_PAGE;
+    mem_buff_index = 0;
+    i = mem_page_pos;
+    while(i < mem_geo.max_pages) {
+        dfmemEraseSector(i);
+        i += mem_geo.pages_per_sector;
+    }
+    while(!dfmemIsReady());
+
+    DisableIntT5;
+    DisableIntT7;
+    head = 0;
+    tail = 0;
+    num_full = 0;
+    filling = 0;
+    seq = 0;
+    dropped = 0;
+    is_recording = 1;
+    if(gsampIsRunning()) { EnableIntT7; }
+    EnableIntT5;
+    return 1;
+
+}
+
+void jrnlStop(void) {
+
+    DisableIntT5;
+    DisableIntT7;
+    if(filling) { finishPage(); }
+    is_recording = 0;
+    if(gsampIsRunning()) { EnableIntT7; }
+    EnableIntT5;
+
+}
+
+unsigned char jrnlIsRecording(void) {
+
+    return is_recording;
+
+}
+
+void jrnlTick(unsigned char *outputs, unsigned int len) {
+
+    unsigned int i, sum;
+
+    if(!is_recording) { return; }
+
+    // Fletcher style, sensitive to byte order
+    sum = 0;
+    for(i = 0; i < len; i++) {
+        sum = (sum << 1) + (sum >> 15) + outputs[i];
+    }
+    record(JRNL_TICK, (unsigned char*) &sum, sizeof(sum));
+
+}
+
+void jrnlGyro(void) {
+
+    int data[3];
+
+    if(!is_recording) { return; }
+
+    gyroGetIntXYZ(data);
+    record(JRNL_GYRO, (unsigned char*) data, sizeof(data));
+
+}
+
+void jrnlXl(void) {
+
+    int data[3];
+
+    if(!is_recording) { return; }
+
+    xlGetIntXYZ(data);
+    record(JRNL_XL, (unsigned char*) data, sizeof(data));
+
+}
+
+void jrnlTemp(float temp) {
+
+    if(!is_recording) { return; }
+
+    record(JRNL_TEMP, (unsigned char*) &temp, sizeof(temp));
+
+}
+
+void jrnlOffset(float *offset) {
+
+    if(!is_recording) { return; }
+
+    record(JRNL_OFFSET, (unsigned char*) offset, 3*sizeof(float));
+
+}
+
+void jrnlTilt(Quaternion *correction) {
+
+    if(!is_recording) { return; }
+
+    record(JRNL_TILT, (unsigned char*) correction, sizeof(Quaternion));
+
+}
+
+void jrnlRadio(MacPacket packet) {
+
+    Payload pld;
+    unsigned char data[5 + MAX_RADIO_DATA];
+    unsigned int len, src;
+
+    if(!is_recording) { return; }
+
+    pld = macGetPayload(packet);
+    len = payGetDataLength(pld);
+    if(len > MAX_RADIO_DATA) { len = MAX_RADIO_DATA; }
+    src = macGetSrcAddr(packet);
+
+    data[0] = len;
+    data[1] = src & 0xFF;
+    data[2] = src >> 8;
+    data[3] = payGetType(pld);
+    data[4] = payGetStatus(pld);
+    memcpy(data + 5, payGetData(pld), len);
+    record(JRNL_RADIO, data, len + 5);
+
+}
+
+void jrnlFrame(CvResult info) {
+
+    JournalFrameStruct summary;
+
+    if(!is_recording) { return; }
+
+    summary.frame_num = info->frame_num;
+    summary.mass = info->mass;
+    memcpy(summary.bearing, info->bearing, sizeof(summary.bearing));
+    summary.level = info->level;
+    memcpy(summary.hazard, info->hazard, sizeof(summary.hazard));
+    record(JRNL_FRAME, (unsigned char*) &summary, sizeof(summary));
+
+}
+
+void jrnlProcess(void) {
+
+    if(!is_ready || num_full == 0) { return; }
+
+    if(mem_page_pos < mem_geo.max_pages) {
+        // Region was erased at start
+        dfmemWriteBuffer((unsigned char*) &pages[tail],
+                    sizeof(JournalPageStruct), 0, mem_buff_index);
+        dfmemWriteBuffer2MemoryNoErase(mem_page_pos, mem_buff_index);
+        mem_buff_index ^= 0x01;
+        mem_page_pos++;
+    } else if(is_recording) {
+        jrnlStop();     // Flash full, remaining buffers are discarded
+    }
+
+    tail = (tail + 1) % JRNL_NUM_BUFFERS;
+    DisableIntT5;
+    DisableIntT7;
+    num_full--;
+    if(gsampIsRunning()) { EnableIntT7; }
+    EnableIntT5;
+
+}
+
+// =========== Private Functions ===============================================
+
+// Records arrive from the background and both timer interrupts. Enable
+// bits are restored rather than set so setup order is not disturbed.
+static void record(unsigned char type, unsigned char *data, unsigned int len) {
+
+    unsigned int t5, t7;
+    unsigned long now;
+
+    t5 = _T5IE;
+    t7 = _T7IE;
+    DisableIntT5;
+    DisableIntT7;
+
+    if(is_recording) {
+        now = sclockGetLocalTicks();
+        if(!append(type, now, data, len)) { dropped++; }
+    }
+
+    _T7IE = t7;
+    _T5IE = t5;
+
+}
+
+static unsigned int append(unsigned char type, unsigned long now,
+                        unsigned char *data, unsigned int len) {
+
+    JournalPageStruct *page;
+    unsigned long delta;
+    unsigned char *dst;
+
+    page = &pages[head];
+    if(filling && page->used + RECORD_HEADER + len + RECORD_HEADER
+        + sizeof(unsigned long) > JRNL_PAGE_DATA) {
+        finishPage();
+        page = &pages[head];
+    }
+
+    if(!filling) {
+        if(num_full >= JRNL_NUM_BUFFERS) { return 0; }
+        page->time = now;
+        page->seq = seq++;
+        page->used = 0;
+        page->dropped = dropped;
+        dropped = 0;
+        last_time = now;
+        filling = 1;
+    }
+
+    delta = now - last_time;
+    if(delta > 0xFFFF) {
+        dst = page->data + page->used;
+        dst[0] = JRNL_TIME;
+        dst[1] = 0;
+        dst[2] = 0;
+        memcpy(dst + RECORD_HEADER, &now, sizeof(now));
+        page->used += RECORD_HEADER + sizeof(now);
+        delta = 0;
+    }
+
+    dst = page->data + page->used;
+    dst[0] = type;
+    dst[1] = delta & 0xFF;
+    dst[2] = (delta >> 8) & 0xFF;
+    memcpy(dst + RECORD_HEADER, data, len);
+    page->used += RECORD_HEADER + len;
+    last_time = now;
+    return 1;
+
+}
+
+// Hand the page being filled to the background writer. Timers masked.
+static void finishPage(void) {
+
+    head = (head + 1) % JRNL_NUM_BUFFERS;
+    num_full++;
+    filling = 0;
+
+}
@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Input Journal for Flight Replay
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - While recording, the inputs to the control path are journaled to
+ *    flash: raw gyro and accelerometer counts, gyro temperature, received
+ *    radio packets, vision frame summaries and control ticks. Each control
+ *    tick carries a checksum of the outputs so a replay can be verified.
+ *  - State computed in the background is applied on a control tick and
+ *    journaled there: gyro calibration offsets and tilt corrections. The
+ *    accelerometer correction runs on the tick from journaled readings.
+ *  - Only recording is provided. There is no replay harness, and the
+ *    sensor drivers have no injection point, so records are decoded and
+ *    fed back off board. Commands still take effect in the background at
+ *    the time their radio record was journaled, not on a tick, so replay
+ *    is exact only between commands.
+ *  - Records are [type][ticks since previous record, 2 bytes][payload].
+ *    Payload length is fixed by type, except radio records which start
+ *    with their own length byte. A JRNL_TIME record with the full local
+ *    time is inserted whenever the delta would overflow.
+ *  - Records are packed into RAM page buffers from any context and never
+ *    straddle pages. jrnlProcess() writes full pages from the background.
+ *    Records that find no free buffer are dropped and counted in the next
+ *    page header.
+ *  - Shares the flash log region with the telemetry logger and the sensor
+ *    recorder. Run one at a time.
+ */
+
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#include "mac_packet.h"
+#include "cv.h"
+#include "quat.h"
+
+#define JRNL_START_PAGE         (0x80)
+#define JRNL_PAGE_DATA          (518)   // Fills a 528 byte page
+#define JRNL_NUM_BUFFERS        (3)
+
+typedef enum {
+    JRNL_TICK = 1,          // Control tick, 2 byte output checksum
+    JRNL_GYRO,              // Raw gyro counts, int[3]
+    JRNL_XL,                // Raw accelerometer counts, int[3]
+    JRNL_TEMP,              // Gyro temperature, float
+    JRNL_RADIO,             // Length, source address, type, status, data
+    JRNL_FRAME,             // JournalFrameStruct
+    JRNL_TIME,              // Full local ticks, unsigned long
+    JRNL_OFFSET,            // Gyro offset taking effect, float[3]
+    JRNL_TILT,              // Tilt correction taking effect, Quaternion
+} JournalRecordType;
+
+// Frame summary, the fields used by the behavior layer
+typedef struct {
+    unsigned int frame_num;     // (2)
+    unsigned long mass;         // (4)
+    float bearing[3];           // (12)
+    unsigned char level;        // (1)
+    unsigned char hazard[CV_HAZARD_SECTORS]; // (8)
+} JournalFrameStruct;
+
+typedef struct {
+    unsigned long time;     // (4) Local ticks the first record is relative to
+    unsigned int seq;       // (2) Page sequence number
+    unsigned int used;      // (2) Bytes of data holding records
+    unsigned int dropped;   // (2) Records dropped just before this page
+    unsigned char data[JRNL_PAGE_DATA]; // (518)
+} JournalPageStruct;
+
+/**
+ * Set up the journal
+ */
+void jrnlSetup(void);
+
+/**
+ * Erase the log region and begin journaling. Blocks during the erase.
+ * @return 1 if started, 0 otherwise
+ */
+unsigned int jrnlStart(void);
+
+/**
+ * Stop journaling. Buffered records are still written by jrnlProcess().
+ */
+void jrnlStop(void);
+
+/**
+ * Returns 1 while journaling, 0 otherwise
+ */
+unsigned char jrnlIsRecording(void);
+
+/**
+ * Journal the end of a control tick
+ * @param outputs - Regulator outputs to checksum
+ * @param len - Length of outputs in bytes
+ */
+void jrnlTick(unsigned char *outputs, unsigned int len);
+
+/**
+ * Journal the latest raw gyro reading
+ */
+void jrnlGyro(void);
+
+/**
+ * Journal the latest raw accelerometer reading
+ */
+void jrnlXl(void);
+
+/**
+ * Journal a gyro temperature reading
+ * @param temp - Temperature in degrees C
+ */
+void jrnlTemp(float temp);
+
+/**
+ * Journal a gyro offset as it takes effect
+ * @param offset - x, y, z offsets in rad/s
+ */
+void jrnlOffset(float *offset);
+
+/**
+ * Journal a tilt correction as it takes effect
+ * @param correction - New correction rotation
+ */
+void jrnlTilt(Quaternion *correction);
+
+/**
+ * Journal a received packet
+ * @param packet - Packet as dequeued from the radio
+ */
+void jrnlRadio(MacPacket packet);
+
+/**
+ * Journal a processed vision frame
+ * @param info - Frame results
+ */
+void jrnlFrame(CvResult info);
+
+/**
+ * Write full page buffers to flash. Call regularly from the background.
+ */
+void jrnlProcess(void);
+
+#endif // __JOURNAL_H
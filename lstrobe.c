@@ -44,14 +44,24 @@
 #include "sys_clock.h"
 #include "cam.h"
 
-#define DEFAULT_ON_TIME         (0)
+#include <stdlib.h>
+
+#define DEFAULT_ON_TIME         (625/4)     // 1 ms
 #define DEFAULT_OFF_TIME        (0)
- 
+#define DEFAULT_KP              (0.5)
+#define DEFAULT_KI              (0.05)
+
 #define STROBE_ON               (1)
 #define STROBE_OFF              (0)
 #define STROBE                  (LED_IR)
 
 #define RUNS_BEFORE_CALIB       (50)
+#define NO_CODE                 (0xFFFF)    // Flash every period
+
+#define TICKS_PER_COUNT_SHIFT   (2)         // Timer 3 counts 4 clock ticks
+#define FRAC_BITS               (8)         // Period fraction, 1/256 tick
+#define LOCK_PERIODS            (4)         // In tolerance before locked
+#define MAX_PERIOD_COUNTS       (0xFFFF)    // PR3 is 16 bits
 
 typedef enum {
     LT_ON = 0,
@@ -63,8 +73,22 @@ static LTimerState state;
 static unsigned char is_ready = 0;
 static LStrobeParamStruct target;
 static unsigned int runs;
+static volatile unsigned int code_word, code_pos;
+
+// Phase tracking, period and accumulator in 1/256 ticks
+static DirEntry peer;
+static volatile unsigned long period_frac, phase_acc;
+static volatile unsigned long edge_time;
+static volatile unsigned char edge_ready;
+static unsigned long nominal_frac, phase_offset;
+static float kp, ki, integral;
+static unsigned int in_tolerance;
+static LStrobeStatsStruct stats;
 
 static void phaseLock(LStrobeParam param);
+static void phaseLockPeer(void);
+static long phaseError(unsigned long time);
+static unsigned int cycleFits(unsigned long frame_period);
 static void setupTimer3(void);
 
 void lstrobeSetup(void) {
@@ -75,6 +99,15 @@ void lstrobeSetup(void) {
     state = LT_OFF;
 
     runs = 0;
+    code_word = NO_CODE;
+    code_pos = LSTROBE_CODE_LENGTH - 1;
+    target.on_time = DEFAULT_ON_TIME;
+    target.off_time = DEFAULT_OFF_TIME;
+    peer = NULL;
+    period_frac = 0;
+    phase_offset = 0;
+    kp = DEFAULT_KP;
+    ki = DEFAULT_KI;
     is_ready = 1;
     
 } 
@@ -93,22 +126,150 @@ void lstrobeGetParam(LStrobeParam param) {
     param->period = target.period;
     param->period_offset = target.period_offset;
     param->on_time = target.on_time;
-    param->off_time = param->off_time;
+    param->off_time = target.off_time;
 
 }
 
 void lstrobeStart(void) {
 
     if(!is_ready) { return; }
+    peer = NULL;
+    period_frac = 0;
     phaseLock(&target);
     
     
+}
+
+unsigned int lstrobeTrack(DirEntry entry) {
+
+    if(!is_ready || entry == NULL || entry->frame_period == 0) { return 0; }
+    if(!cycleFits(entry->frame_period)) { return 0; }
+    if(entry == peer) { return 1; } // Timing read again on next period
+
+    peer = entry;
+    phaseLockPeer();
+    return 1;
+
+}
+
+unsigned int lstrobeIsTracking(void) {
+
+    return peer != NULL;
+
+}
+
+void lstrobeSetPhase(unsigned long offset) {
+
+    phase_offset = offset;
+    if(peer != NULL) { phaseLockPeer(); }
+
+}
+
+void lstrobeSetGains(float p, float i) {
+
+    kp = p;
+    ki = i;
+
+}
+
+void lstrobeProcess(void) {
+
+    unsigned long time, magnitude;
+    long error, correction;
+    float limit;
+
+    if(!is_ready || peer == NULL || !edge_ready) { return; }
+
+    DisableIntT3;
+    time = edge_time;
+    edge_ready = 0;
+    EnableIntT3;
+
+    // Camera period may have been refined since the last measurement. If
+    // it no longer fits, stop tracking but hold the last period so the
+    // code keeps blinking.
+    if(!cycleFits(peer->frame_period)) {
+        peer = NULL;
+        return;
+    }
+    nominal_frac = (LSTROBE_FRAMES_PER_FLASH*peer->frame_period) << FRAC_BITS;
+
+    // The integral alone never asks for more than the correction limit
+    error = phaseError(time);
+    integral += error;
+    limit = (float)(nominal_frac >> (FRAC_BITS + 2));
+    if(ki*integral > limit) {
+        integral = limit/ki;
+    } else if(ki*integral < -limit) {
+        integral = -limit/ki;
+    }
+    correction = (long)((kp*error + ki*integral)*(1 << FRAC_BITS));
+    if(correction > (long)(nominal_frac >> 2)) {
+        correction = nominal_frac >> 2;
+    } else if(correction < -(long)(nominal_frac >> 2)) {
+        correction = -(long)(nominal_frac >> 2);
+    }
+
+    // Late edges shorten the next period
+    DisableIntT3;
+    period_frac = nominal_frac - correction;
+    EnableIntT3;
+
+    magnitude = error < 0 ? -error : error;
+    stats.last_error = error;
+    if(magnitude > stats.max_error) { stats.max_error = magnitude; }
+    stats.sum_error += magnitude;
+    stats.count++;
+    if(magnitude <= LSTROBE_LOCK_TOLERANCE) {
+        if(in_tolerance < LOCK_PERIODS) { in_tolerance++; }
+    } else {
+        in_tolerance = 0;
+    }
+    stats.locked = in_tolerance >= LOCK_PERIODS;
+
+}
+
+void lstrobeGetStats(LStrobeStats dst, unsigned char clear) {
+
+    *dst = stats;
+    if(clear) {
+        stats.max_error = 0;
+        stats.sum_error = 0;
+        stats.count = 0;
+    }
+
 }
  
+void lstrobeSetId(unsigned int id) {
+
+    unsigned int i, word;
+
+    word = LSTROBE_SYNC;
+    for(i = LSTROBE_ID_BITS; i > 0; i--) {
+        word = (word << 2) | (((id >> (i - 1)) & 0x01) ? 0x02 : 0x01);
+    }
+
+    DisableIntT3;
+    code_word = word;
+    code_pos = LSTROBE_CODE_LENGTH - 1;
+    EnableIntT3;
+
+}
+
+void lstrobeClearId(void) {
+
+    DisableIntT3;
+    code_word = NO_CODE;
+    EnableIntT3;
+
+}
+
 // ====== Private Functions ===================================================
  
 void __attribute__((interrupt, no_auto_psv)) _T3Interrupt(void) {
 
+    unsigned int counts;
+
     if(state == LT_PL) {
         state = LT_OFF; // Once synchronized, proceed to OFF state immediately
     }
@@ -116,13 +277,29 @@ void __attribute__((interrupt, no_auto_psv)) _T3Interrupt(void) {
     if(state == LT_ON) {
         STROBE = STROBE_OFF;
         LED_RED = 0;
-        PR3 = target.off_time;
+        if(period_frac != 0) {
+            // Whole counts left in this period, remainder carried over
+            phase_acc += period_frac;
+            counts = (phase_acc >> (FRAC_BITS + TICKS_PER_COUNT_SHIFT))
+                        - target.on_time;
+            phase_acc -= (unsigned long)(counts + target.on_time)
+                        << (FRAC_BITS + TICKS_PER_COUNT_SHIFT);
+            PR3 = counts - 1;       // Timer period is PR3 + 1 counts
+        } else {
+            PR3 = target.off_time;
+        }
         state = LT_OFF;
 
     } else if(state == LT_OFF) {
-        STROBE = STROBE_ON;
-        LED_RED = 1;
-        PR3 = target.on_time;
+        edge_time = sclockGetGlobalTicks();
+        edge_ready = 1;
+        // Zero bits keep the strobe dark but the timing running
+        if((code_word >> code_pos) & 0x01) {
+            STROBE = STROBE_ON;
+            LED_RED = 1;
+        }
+        code_pos = (code_pos == 0) ? LSTROBE_CODE_LENGTH - 1 : code_pos - 1;
+        PR3 = (period_frac != 0) ? target.on_time - 1 : target.on_time;
         state = LT_ON;
     } 
 
@@ -141,6 +318,65 @@ static void phaseLock(LStrobeParam params) {
     EnableIntT3;   
     
 }
+
+// Start the next period at the target phase and restart the loop
+static void phaseLockPeer(void) {
+
+    unsigned long period, counts;
+    long delay;
+
+    period = LSTROBE_FRAMES_PER_FLASH*peer->frame_period;
+    nominal_frac = period << FRAC_BITS;
+    integral = 0.0;
+    in_tolerance = 0;
+    stats.locked = 0;
+
+    DisableIntT3;
+    delay = -phaseError(sclockGetGlobalTicks());
+    if(delay <= 0) { delay += period; }
+    counts = delay >> TICKS_PER_COUNT_SHIFT;
+    PR3 = counts > 0xFFFF ? 0xFFFF : counts;    // Loop removes the rest
+    TMR3 = 0;
+    period_frac = nominal_frac;
+    phase_acc = 0;
+    edge_ready = 0;
+    state = LT_PL;
+    EnableIntT3;
+
+}
+
+// The off part of a cycle stretched by the largest correction must fit in
+// the timer period register. Rules out cameras slower than about 15 fps.
+static unsigned int cycleFits(unsigned long frame_period) {
+
+    unsigned long cycle;
+
+    cycle = LSTROBE_FRAMES_PER_FLASH*frame_period;
+    cycle += cycle >> 2;
+    return (cycle >> TICKS_PER_COUNT_SHIFT) <= target.on_time + MAX_PERIOD_COUNTS;
+
+}
+
+// Offset of a time from the nearest target phase, in ticks. Cycles start
+// where global time modulo the cycle equals the camera's frame phase, which
+// slips once every 2^32 ticks.
+static long phaseError(unsigned long time) {
+
+    unsigned long period, cycle, target_phase;
+    long error;
+
+    period = peer->frame_period;
+    cycle = LSTROBE_FRAMES_PER_FLASH*period;
+    target_phase = (peer->frame_start % period + phase_offset) % cycle;
+    error = (long)(time % cycle) - (long)target_phase;
+    if(error > (long)(cycle/2)) {
+        error -= cycle;
+    } else if(error < -(long)(cycle/2)) {
+        error += cycle;
+    }
+    return error;
+
+}
  
 /**
  * LED strobe timer setup
@@ -161,5 +397,3 @@ static void setupTimer3(void) {
     T3CONbits.TON = 1;              // Enable module
 
 }
-
-
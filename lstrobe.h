@@ -36,11 +36,45 @@
  * Revisions:
  *  Humphrey Hu		2012-04-25		Initial implementation 
  *                      
+ * Notes:
+ *  - Each strobe period either flashes or stays dark according to a 16 bit
+ *    code word sent MSB first: the sync pattern 1110 followed by the ID bits,
+ *    Manchester coded (1 -> 10, 0 -> 01). Manchester data never contains
+ *    three ones in a row so the sync pattern is unique, and a beacon is never
+ *    dark for more than two periods.
+ *  - IDs are the low bits of the network address.
+ *  - Timer 3 counts 4 system clock ticks. Parameters are in timer counts.
+ *  - lstrobeTrack() locks the strobe to a peer camera. The start of every
+ *    strobe period is timestamped, and lstrobeProcess() compares it against
+ *    the peer's frame_start and frame_period from the directory. A PI loop
+ *    then trims the strobe period. The period is kept in 1/256 ticks and
+ *    a fractional accumulator carries the sub-count remainder between
+ *    periods, so truncation to timer counts does not build up drift.
+ *  - The off part of a period is a single Timer 3 period of at most 65536
+ *    counts. Cameras whose strobe cycle would not fit, even with the
+ *    largest correction applied, are not tracked. If a tracked camera's
+ *    period is later refined past that, tracking stops and the strobe keeps
+ *    its last period and code until lstrobeTrack() is called again. The
+ *    integral term is bounded by the same quarter-cycle limit as the
+ *    correction.
+ *  - A strobe cycle is LSTROBE_FRAMES_PER_FLASH frames of the tracked
+ *    camera. Cycles are aligned to global time, so every bird tracking the
+ *    same camera agrees on which frame is first. The phase offset places
+ *    the period start relative to the start of that first frame.
  */
 
 #ifndef __LSTROBE_H
 #define __LSTROBE_H
 
+#include "directory.h"
+
+#define LSTROBE_FRAMES_PER_FLASH    (5)     // Camera frames per strobe period
+#define LSTROBE_CODE_LENGTH         (16)    // Strobe periods per code word
+#define LSTROBE_SYNC                (0xE)
+#define LSTROBE_SYNC_BITS           (4)
+#define LSTROBE_ID_BITS             (6)
+#define LSTROBE_ID_MASK             (0x3F)
+
 typedef struct {
     unsigned int period;
     unsigned int period_offset;
@@ -50,9 +84,74 @@ typedef struct {
 
 typedef LStrobeParamStruct* LStrobeParam;
 
+// Phase error against the tracked camera, in system clock ticks
+typedef struct {
+    long last_error;
+    unsigned long max_error;    // Largest magnitude
+    unsigned long sum_error;    // Sum of magnitudes
+    unsigned int count;         // Periods measured
+    unsigned char locked;       // Within LSTROBE_LOCK_TOLERANCE
+} LStrobeStatsStruct;
+
+typedef LStrobeStatsStruct* LStrobeStats;
+
+#define LSTROBE_LOCK_TOLERANCE      (625)   // 1 ms
+
 void lstrobeSetup(void);
 void lstrobeSetParam(LStrobeParam params);
 void lstrobeGetParam(LStrobeParam params);
 void lstrobeStart(void);
 
+/**
+ * Phase-lock the strobe to a peer camera. Calling again with the same peer
+ * only refreshes its timing from the directory.
+ * @param peer - Directory entry holding the camera's frame timing
+ * @return 1 if tracking, 0 if the strobe cycle would not fit in Timer 3
+ */
+unsigned int lstrobeTrack(DirEntry peer);
+
+/**
+ * Check whether the strobe is still locked to a peer camera
+ * @return 1 if tracking, 0 if never started or dropped by lstrobeProcess()
+ */
+unsigned int lstrobeIsTracking(void);
+
+/**
+ * Set where the strobe fires within the cycle. Restarts the lock if
+ * tracking.
+ * @param offset - Ticks after the start of the first frame of the cycle
+ */
+void lstrobeSetPhase(unsigned long offset);
+
+/**
+ * Set the phase tracking loop gains
+ * @param kp - Fraction of the phase error removed each period
+ * @param ki - Fraction of the error integral applied each period
+ */
+void lstrobeSetGains(float kp, float ki);
+
+/**
+ * Run the phase tracking loop once per measured period. Call regularly
+ * from the background.
+ */
+void lstrobeProcess(void);
+
+/**
+ * Read and optionally clear the phase error statistics
+ * @param stats - Struct to populate
+ * @param clear - Reset statistics after reading if nonzero
+ */
+void lstrobeGetStats(LStrobeStats stats, unsigned char clear);
+
+/**
+ * Modulate the strobe with an ID code
+ * @param id - Identifier, only the low LSTROBE_ID_BITS bits are used
+ */
+void lstrobeSetId(unsigned int id);
+
+/**
+ * Flash every period without a code
+ */
+void lstrobeClearId(void);
+
 #endif
@@ -65,6 +65,19 @@
 #include "attitude.h"
 #include "net.h"
 #include "clock_sync.h"
+#include "txq.h"
+#include "mesh.h"
+#include "aggregate.h"
+#include "pose_history.h"
+#include "triangulate.h"
+#include "tilt_correct.h"
+#include "gyro_sampler.h"
+#include "gyro_calib.h"
+#include "sensor_dump.h"
+#include "journal.h"
+#include "schedule.h"
+#include "lstrobe.h"
+#include "strobe_plan.h"
 
 // Device Drivers
 #include "init_default.h"
@@ -89,8 +102,10 @@
 #define FCY                         (40000000)  // 40 MIPS   
 #define REGULATOR_FCY               (300)       // 300 Hz
 #define RADIO_FCY                   (200)       // 200 Hz
+#define GYRO_SAMPLE_FCY             (1200)      // 1200 Hz, 4 per control tick
 #define RADIO_TX_QUEUE_SIZE         (40)        // 40 Outgoing
 #define RADIO_RX_QUEUE_SIZE         (40)        // 40 Incoming
+#define TXQ_SIZE                    (40)        // 40 Pending transmit credits
 
 #define DIRECTORY_SIZE              (20)        // Network size
 #define NUM_CAM_FRAMES              (1)         // Camera driver frames
@@ -132,6 +147,15 @@ int main(void) {
         processRadioBuffer();
         cmdProcessBuffer();        
         telemProcess();        
+        meshProcess();
+        aggProcess();
+        gcalProcess();
+        sdumpProcess();
+        jrnlProcess();
+        schedProcess();
+        splanProcess();
+        lstrobeProcess();
+        txqProcess();
 
         now = sclockGetGlobalMillis();
         phase = now % 2000;
@@ -156,6 +180,12 @@ void processRadioBuffer(void) {
     packet = radioDequeueRxPacket();
     if(packet == NULL) { return; }
 
+    jrnlRadio(packet);
+    netUpdateLinkQuality(packet);
+
+    // Relayed and duplicate packets never reach the command queue
+    if(meshProcessPacket(packet)) { return; }
+
     // If enqueue fails, clean up packet
     if(cmdQueuePacket(packet) == 0) {
         radioReturnPacket(packet);
@@ -182,11 +212,10 @@ void setupAll(void) {
     dfmemSetup();                           // Flash memory device
     //camSetup(cam_frames, NUM_CAM_FRAMES);   // Camera device
     
-    /* Accelerometer setup
+    // Accelerometer setup, read by the gyro sampler
     xlSetup();
     xlSetRange(16);                         // +- 16 g range
     xlSetOutputRate(0, 0x0c);               // 800 Hz
-    */
     gyroSetup();
     gyroSetDeadZone(25);
     
@@ -195,8 +224,14 @@ void setupAll(void) {
     setRandomSeed();                // Seeds random number generation using IMU sensors
     cmdSetup(RADIO_RX_QUEUE_SIZE);  // Command packet processing module
     radioInit(RADIO_TX_QUEUE_SIZE, RADIO_RX_QUEUE_SIZE);    
+    txqSetup(TXQ_SIZE);             // Non-blocking transmit queue
     setupTimer6(RADIO_FCY); // Radio and buffer loop timer
     netSetup(DIRECTORY_SIZE); // Networking module
+    meshSetup();                // Multi-hop forwarding
+    aggSetup();                 // Telemetry aggregation
+    triSetup();                 // Cooperative localization
+    lstrobeSetup();             // Beacon strobe
+    splanSetup();               // Strobe slots from camera timing
     attemptNetworkConfig();
     radioSetSrcAddr(netGetLocalAddress());
     radioSetSrcPanID(netGetLocalPanID());    
@@ -209,6 +244,12 @@ void setupAll(void) {
     
     telemSetup();                   // Telemetry logger
     telemSetSubsampleRate(TELEM_SUBSAMPLE);
+    phistSetup();                   // Attitude history
+    tiltSetup();                    // Attitude tilt correction
+    gsampSetup(GYRO_SAMPLE_FCY);    // Oversampled gyro integration
+    gcalSetup();                    // Stored gyro calibration
+    sdumpSetup(GYRO_SAMPLE_FCY);    // Raw sensor recorder
+    jrnlSetup();                    // Input journal for replay
     rgltrSetup(1.0/REGULATOR_FCY);  // Control module
     rgltrSetOff();
     rgltrStartLogging();    
@@ -226,6 +267,7 @@ void setupAll(void) {
     DisableIntT6;
     //camStart();     // Start camera capture
     attStart();     // Start attitude estimation 
+    gsampStart();   // Start gyro oversampling
     EnableIntT5;    // Start control loop
     EnableIntT6;
 
@@ -257,6 +299,7 @@ static void attemptNetworkConfig(void) {
     
     while(!netAddressReceived()) {
         netRequestAddress();        
+        txqProcess();
         delay_ms(300);
         processRadioBuffer();
         cmdProcessBuffer();
@@ -272,6 +315,7 @@ static void attemptClockSync(void) {
     
     while(!clksyncIsDone()) {
         clksyncSync();        
+        txqProcess();
         delay_ms(50);
         processRadioBuffer();
         cmdProcessBuffer();
@@ -294,7 +338,12 @@ static void batteryLowCallback(void) {
  */
 void __attribute__((interrupt, no_auto_psv)) _T5Interrupt(void) {
     
-    gyroReadXYZ();    
+    if(!gsampIsRunning()) {
+        gyroReadXYZ();      // Otherwise read by Timer 7
+        jrnlGyro();
+    }
+    gcalSample();
+    schedRun();         // Timed commands take effect this tick
     rgltrRunController();    
     telemLog();
     
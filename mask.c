@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Run Length Encoded Binary Masks
+ *
+ * v.beta
+ */
+
+#include "mask.h"
+
+#include <string.h>
+
+#define ROW_MAX_RUNS            (DS_IMAGE_COLS/2 + 1)
+
+typedef struct {
+    unsigned char start;
+    unsigned char end;
+} SpanStruct;
+
+// Runs of one row within a mask
+typedef struct {
+    unsigned int first;
+    unsigned int num;
+} RowIndexStruct;
+
+// =========== Function Stubs ==================================================
+static void indexRows(Mask mask, RowIndexStruct *index);
+static unsigned int getSpans(Mask mask, RowIndexStruct *index, int row,
+                    SpanStruct *spans, int widen);
+static unsigned int intersectSpans(SpanStruct *a, unsigned int num_a,
+                    SpanStruct *b, unsigned int num_b, SpanStruct *out);
+static void appendRun(Mask mask, unsigned int row, unsigned int start,
+                    unsigned int end);
+
+// =========== Public Functions ================================================
+
+unsigned int maskFromFrame(CamFrame frame, unsigned char threshold, Mask mask) {
+
+    unsigned int i;
+
+    maskClear(mask);
+    for(i = 0; i < DS_IMAGE_ROWS; i++) {
+        maskAddRow(mask, i, frame->pixels[i], threshold);
+    }
+
+    return mask->num_runs;
+
+}
+
+void maskClear(Mask mask) {
+
+    mask->num_runs = 0;
+    mask->overflow = 0;
+
+}
+
+void maskAddRow(Mask mask, unsigned int row, unsigned char *pixels,
+                unsigned char threshold) {
+
+    unsigned int j, start;
+
+    j = 0;
+    while(j < DS_IMAGE_COLS) {
+        while(j < DS_IMAGE_COLS && pixels[j] <= threshold) { j++; }
+        if(j == DS_IMAGE_COLS) { break; }
+        start = j;
+        while(j < DS_IMAGE_COLS && pixels[j] > threshold) { j++; }
+        appendRun(mask, row, start, j);
+    }
+
+}
+
+void maskToFrame(Mask mask, CamFrame frame) {
+
+    unsigned int i;
+    MaskRunStruct *run;
+
+    memset(frame->pixels, 0, DS_IMAGE_ROWS*DS_IMAGE_COLS);
+    for(i = 0; i < mask->num_runs; i++) {
+        run = &mask->runs[i];
+        memset(&frame->pixels[run->row][run->start], 0xFF, run->end - run->start);
+    }
+
+}
+
+void maskErode(Mask src, Mask dst) {
+
+    int i;
+    unsigned int j, num, num_tmp;
+    RowIndexStruct index[DS_IMAGE_ROWS];
+    SpanStruct above[ROW_MAX_RUNS], mid[ROW_MAX_RUNS], below[ROW_MAX_RUNS],
+                tmp[ROW_MAX_RUNS];
+
+    dst->num_runs = 0;
+    dst->overflow = src->overflow;
+    if(src->num_runs == 0) { return; }
+    indexRows(src, index);
+
+    // A pixel survives if its row and both neighbouring rows are set in
+    // its column and the columns to either side
+    for(i = src->runs[0].row; i <= src->runs[src->num_runs - 1].row; i++) {
+        num = getSpans(src, index, i, mid, -1);
+        if(num == 0) { continue; }
+        num_tmp = getSpans(src, index, i - 1, above, -1);
+        num = intersectSpans(mid, num, above, num_tmp, tmp);
+        if(num == 0) { continue; }
+        num_tmp = getSpans(src, index, i + 1, below, -1);
+        num = intersectSpans(tmp, num, below, num_tmp, mid);
+        for(j = 0; j < num; j++) {
+            appendRun(dst, i, mid[j].start, mid[j].end);
+        }
+    }
+
+}
+
+void maskDilate(Mask src, Mask dst) {
+
+    int i;
+    unsigned int j, k, best, num[3], pos[3];
+    unsigned int start, end, open;
+    RowIndexStruct index[DS_IMAGE_ROWS];
+    SpanStruct spans[3][ROW_MAX_RUNS];
+
+    dst->num_runs = 0;
+    dst->overflow = src->overflow;
+    if(src->num_runs == 0) { return; }
+    indexRows(src, index);
+
+    for(i = src->runs[0].row - 1; i <= src->runs[src->num_runs - 1].row + 1; i++) {
+        if(i < 0 || i >= DS_IMAGE_ROWS) { continue; }
+
+        for(k = 0; k < 3; k++) {
+            num[k] = getSpans(src, index, i + k - 1, spans[k], 1);
+            pos[k] = 0;
+        }
+
+        // Merge the widened spans of three rows in column order
+        open = 0;
+        start = 0;
+        end = 0;
+        while(1) {
+            best = 3;
+            for(k = 0; k < 3; k++) {
+                if(pos[k] < num[k] && (best == 3 ||
+                    spans[k][pos[k]].start < spans[best][pos[best]].start)) {
+                    best = k;
+                }
+            }
+            if(best == 3) { break; }
+            j = pos[best]++;
+            if(open && spans[best][j].start <= end) {
+                if(spans[best][j].end > end) { end = spans[best][j].end; }
+            } else {
+                if(open) { appendRun(dst, i, start, end); }
+                start = spans[best][j].start;
+                end = spans[best][j].end;
+                open = 1;
+            }
+        }
+        if(open) { appendRun(dst, i, start, end); }
+    }
+
+}
+
+void maskOpen(Mask src, Mask dst, Mask tmp) {
+
+    maskErode(src, tmp);
+    maskDilate(tmp, dst);
+
+}
+
+void maskClose(Mask src, Mask dst, Mask tmp) {
+
+    maskDilate(src, tmp);
+    maskErode(tmp, dst);
+
+}
+
+unsigned int maskArea(Mask mask) {
+
+    unsigned int i, area;
+
+    area = 0;
+    for(i = 0; i < mask->num_runs; i++) {
+        area += mask->runs[i].end - mask->runs[i].start;
+    }
+    return area;
+
+}
+
+unsigned int maskBounds(Mask mask, unsigned char *bounds) {
+
+    unsigned int i;
+
+    if(mask->num_runs == 0) { return 0; }
+
+    bounds[0] = mask->runs[0].start;
+    bounds[1] = mask->runs[0].row;
+    bounds[2] = mask->runs[0].end - 1;
+    bounds[3] = mask->runs[mask->num_runs - 1].row;
+    for(i = 1; i < mask->num_runs; i++) {
+        if(mask->runs[i].start < bounds[0]) { bounds[0] = mask->runs[i].start; }
+        if(mask->runs[i].end - 1 > bounds[2]) { bounds[2] = mask->runs[i].end - 1; }
+    }
+    return 1;
+
+}
+
+// =========== Private Functions ===============================================
+
+static void indexRows(Mask mask, RowIndexStruct *index) {
+
+    unsigned int i, row;
+
+    memset(index, 0, DS_IMAGE_ROWS*sizeof(RowIndexStruct));
+    for(i = 0; i < mask->num_runs; i++) {
+        row = mask->runs[i].row;
+        if(index[row].num == 0) { index[row].first = i; }
+        index[row].num++;
+    }
+
+}
+
+// Copy out the runs of a row, each grown (widen > 0) or shrunk (widen < 0)
+// by one pixel per side and clipped to the frame
+static unsigned int getSpans(Mask mask, RowIndexStruct *index, int row,
+                    SpanStruct *spans, int widen) {
+
+    unsigned int i, num;
+    int start, end;
+    MaskRunStruct *run;
+
+    if(row < 0 || row >= DS_IMAGE_ROWS) { return 0; }
+
+    num = 0;
+    run = &mask->runs[index[row].first];
+    for(i = 0; i < index[row].num; i++, run++) {
+        start = run->start - widen;
+        end = run->end + widen;
+        if(start < 0) { start = 0; }
+        if(end > DS_IMAGE_COLS) { end = DS_IMAGE_COLS; }
+        if(start >= end) { continue; }
+        spans[num].start = start;
+        spans[num].end = end;
+        num++;
+    }
+    return num;
+
+}
+
+static unsigned int intersectSpans(SpanStruct *a, unsigned int num_a,
+                    SpanStruct *b, unsigned int num_b, SpanStruct *out) {
+
+    unsigned int i, j, num;
+    unsigned char start, end;
+
+    i = 0;
+    j = 0;
+    num = 0;
+    while(i < num_a && j < num_b) {
+        start = (a[i].start > b[j].start) ? a[i].start : b[j].start;
+        end = (a[i].end < b[j].end) ? a[i].end : b[j].end;
+        if(start < end) {
+            out[num].start = start;
+            out[num].end = end;
+            num++;
+        }
+        if(a[i].end < b[j].end) { i++; }
+        else { j++; }
+    }
+    return num;
+
+}
+
+static void appendRun(Mask mask, unsigned int row, unsigned int start,
+                    unsigned int end) {
+
+    if(mask->num_runs >= MASK_MAX_RUNS) {
+        mask->overflow = 1;
+        return;
+    }
+    mask->runs[mask->num_runs].row = row;
+    mask->runs[mask->num_runs].start = start;
+    mask->runs[mask->num_runs].end = end;
+    mask->num_runs++;
+
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Run Length Encoded Binary Masks
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - A mask is a list of foreground runs sorted by row and then by column.
+ *    Runs in a row never touch or overlap.
+ *  - Morphology uses a 3x3 square element. Pixels outside the frame count as
+ *    background, so erosion shrinks objects touching the border.
+ *  - Work done by the morphology and query functions grows with the number
+ *    of runs and rows, not with the number of pixels.
+ *  - Masks that would exceed MASK_MAX_RUNS are truncated and flagged.
+ */
+
+#ifndef __MASK_H
+#define __MASK_H
+
+#include "cam.h"
+
+#define MASK_MAX_RUNS           (128)
+
+typedef struct {
+    unsigned char row;
+    unsigned char start;        // First foreground column
+    unsigned char end;          // One past the last foreground column
+} MaskRunStruct;
+
+typedef struct {
+    unsigned int num_runs;
+    unsigned char overflow;     // Runs were dropped
+    MaskRunStruct runs[MASK_MAX_RUNS];
+} MaskStruct;
+
+typedef MaskStruct* Mask;
+
+/**
+ * Build a mask of the pixels brighter than a threshold
+ * @param frame - Source frame
+ * @param threshold - Pixels above this value are foreground
+ * @param mask - Destination mask
+ * @return Number of runs
+ */
+unsigned int maskFromFrame(CamFrame frame, unsigned char threshold, Mask mask);
+
+/**
+ * Empty a mask before adding rows
+ */
+void maskClear(Mask mask);
+
+/**
+ * Append the runs of one row. Rows must be added in increasing order.
+ * @param mask - Destination mask
+ * @param row - Row number
+ * @param pixels - DS_IMAGE_COLS pixels of the row
+ * @param threshold - Pixels above this value are foreground
+ */
+void maskAddRow(Mask mask, unsigned int row, unsigned char *pixels,
+                unsigned char threshold);
+
+/**
+ * Paint a mask into a frame as 0xFF on 0x00
+ */
+void maskToFrame(Mask mask, CamFrame frame);
+
+/**
+ * Morphological operations. Source and destination must differ.
+ */
+void maskErode(Mask src, Mask dst);
+void maskDilate(Mask src, Mask dst);
+
+/**
+ * Erosion then dilation, removes specks
+ * @param tmp - Scratch mask
+ */
+void maskOpen(Mask src, Mask dst, Mask tmp);
+
+/**
+ * Dilation then erosion, fills pinholes
+ * @param tmp - Scratch mask
+ */
+void maskClose(Mask src, Mask dst, Mask tmp);
+
+/**
+ * Number of foreground pixels
+ */
+unsigned int maskArea(Mask mask);
+
+/**
+ * Bounding box of the foreground
+ * @param bounds - Destination for min column, min row, max column, max row
+ * @return 1 if the mask has foreground, 0 if empty
+ */
+unsigned int maskBounds(Mask mask, unsigned char *bounds);
+
+#endif // __MASK_H
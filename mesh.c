@@ -0,0 +1,495 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Multi-hop Mesh Forwarding
+ *
+ * v.beta
+ */
+
+#include "mesh.h"
+#include "net.h"
+#include "directory.h"
+#include "radio.h"
+#include "mac_packet.h"
+#include "payload.h"
+#include "cmd_const.h"
+#include "sys_clock.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ADVERT_PERIOD   (625000)    // 1 s (625 ticks/ms)
+#define ROUTE_LIFETIME          (4)         // Advert periods without refresh
+#define DEFAULT_TTL             (4)
+#define MAX_HOPS                (DEFAULT_TTL)
+#define HOP_COST                (256)       // Cost of a perfect link
+#define MIN_LINK_QUALITY        (32)        // Weaker links are unusable
+#define COST_HYSTERESIS         (64)        // Required improvement to switch
+#define MAX_ADVERT_ITEMS        (12)
+#define ADVERT_RESERVE_CREDITS  (8)
+#define SEEN_SIZE               (16)
+
+#define ROUTE_FLAG_MESH         (0x01)      // Neighbour runs mesh forwarding
+
+// Stored after the application data, copied in and out since the trailer
+// is not necessarily word aligned
+typedef struct {
+    unsigned int origin;
+    unsigned int dest;
+    unsigned int send_time;     // Origin global ticks >> MESH_TIME_SHIFT
+    unsigned char id;
+    unsigned char ttl;
+    unsigned char type;         // Original payload type
+    unsigned char hops;
+} MeshTrailerStruct;
+
+typedef struct {
+    unsigned int addr;
+    unsigned int cost;
+    unsigned int next_hop;
+    unsigned char hops;
+    unsigned char seq;          // Advert sequence number in the first item
+} MeshAdvertItemStruct;
+
+typedef MeshAdvertItemStruct* MeshAdvertItem;
+
+typedef struct {
+    unsigned int origin;
+    unsigned char id;
+} MeshSeenStruct;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static unsigned char next_id, advert_seq;
+static unsigned long advert_period, route_timeout, next_advert;
+
+static MeshStatsStruct stats;
+static MeshSeenStruct seen[SEEN_SIZE];
+static unsigned int seen_head;
+
+// =========== Function Stubs ==================================================
+static void setDataLength(MacPacket packet, unsigned int length);
+static unsigned int checkSeen(unsigned int origin, unsigned char id);
+static unsigned int routeValid(DirEntry entry);
+static unsigned int searchAdvertised(DirEntry entry, void *args);
+static unsigned int linkCost(DirEntry entry);
+static void updateRoute(DirEntry entry, unsigned int via, unsigned int cost,
+                        unsigned char hops);
+static void sendAdvert(void);
+
+// =========== Public Functions ================================================
+
+void meshSetup(void) {
+
+    memset(&stats, 0, sizeof(MeshStatsStruct));
+    memset(seen, 0xFF, sizeof(seen)); // Broadcast address is never an origin
+    seen_head = 0;
+    next_id = 0;
+    advert_seq = 0;
+    next_advert = 0;
+    is_ready = 1;
+    meshSetAdvertPeriod(DEFAULT_ADVERT_PERIOD);
+
+}
+
+void meshSetAdvertPeriod(unsigned long ticks) {
+
+    advert_period = ticks;
+    route_timeout = ticks ? ticks*ROUTE_LIFETIME : ROUTE_LIFETIME*DEFAULT_ADVERT_PERIOD;
+
+}
+
+MacPacket meshRequestPacket(unsigned int data_size) {
+
+    MacPacket packet;
+
+    packet = radioRequestPacket(data_size + MESH_TRAILER_SIZE);
+    if(packet == NULL) { return NULL; }
+    setDataLength(packet, data_size);
+    return packet;
+
+}
+
+unsigned int meshSend(MacPacket packet, unsigned int dest_addr,
+                        TxqCallback callback, void *args) {
+
+    Payload pld;
+    MeshTrailerStruct trailer;
+    unsigned int length, next_hop;
+
+    next_hop = meshGetNextHop(dest_addr);
+    macSetDestAddr(packet, next_hop);
+    macSetDestPan(packet, netGetLocalPanID());
+
+    // Neighbours get the packet as is
+    if(next_hop == dest_addr || !is_ready) {
+        return txqSend(packet, callback, args);
+    }
+
+    pld = macGetPayload(packet);
+    length = payGetDataLength(pld);
+
+    trailer.origin = netGetLocalAddress();
+    trailer.dest = dest_addr;
+    trailer.send_time =
+            (unsigned int)(sclockGetGlobalTicks() >> MESH_TIME_SHIFT);
+    trailer.id = next_id;
+    trailer.ttl = DEFAULT_TTL;
+    trailer.type = payGetType(pld);
+    trailer.hops = 0;
+
+    memcpy(payGetData(pld) + length, &trailer, MESH_TRAILER_SIZE);
+    setDataLength(packet, length + MESH_TRAILER_SIZE);
+    paySetType(pld, CMD_MESH_FORWARD);
+
+    if(!txqSend(packet, callback, args)) {
+        setDataLength(packet, length);
+        paySetType(pld, trailer.type);
+        return 0;
+    }
+
+    // Remember own packets so copies relayed back are dropped
+    checkSeen(trailer.origin, trailer.id);
+    next_id++;
+    stats.originated++;
+    return 1;
+
+}
+
+unsigned int meshGetNextHop(unsigned int dest_addr) {
+
+    DirEntry entry;
+
+    if(dest_addr == NETWORK_BROADCAST_ADDR) { return dest_addr; }
+
+    entry = dirQueryAddress(dest_addr, netGetLocalPanID());
+    if(entry == NULL || !routeValid(entry)) { return dest_addr; }
+    return entry->next_hop;
+
+}
+
+unsigned int meshProcessPacket(MacPacket packet) {
+
+    Payload pld;
+    DirEntry entry;
+    MeshTrailerStruct trailer;
+    unsigned int src_addr, src_pan, length, next_hop, latency;
+    unsigned char *trailer_data;
+
+    if(!is_ready) { return 0; }
+
+    src_addr = macGetSrcAddr(packet);
+    src_pan = macGetSrcPan(packet);
+
+    // Hearing a neighbour directly refreshes the one hop route to it
+    entry = dirQueryAddress(src_addr, src_pan);
+    if(entry != NULL) {
+        updateRoute(entry, src_addr, linkCost(entry), 1);
+    }
+
+    pld = macGetPayload(packet);
+    if(payGetType(pld) != CMD_MESH_FORWARD) { return 0; }
+
+    length = payGetDataLength(pld);
+    if(length < MESH_TRAILER_SIZE) {
+        radioReturnPacket(packet);
+        return 1;
+    }
+    length -= MESH_TRAILER_SIZE;
+    trailer_data = payGetData(pld) + length;
+    memcpy(&trailer, trailer_data, MESH_TRAILER_SIZE);
+
+    if(checkSeen(trailer.origin, trailer.id)) {
+        stats.dropped_dup++;
+        radioReturnPacket(packet);
+        return 1;
+    }
+
+    // Unwrap in place and present the packet as coming from its origin
+    if(trailer.dest == netGetLocalAddress()) {
+        setDataLength(packet, length);
+        paySetType(pld, trailer.type);
+        macSetSrc(packet, src_pan, trailer.origin);
+        latency = (unsigned int)(sclockGetGlobalTicks() >> MESH_TIME_SHIFT)
+                    - trailer.send_time;
+        stats.delivered++;
+        stats.total_hops += trailer.hops + 1;
+        stats.total_latency += latency;
+        if(latency > stats.max_latency) { stats.max_latency = latency; }
+        return 0;
+    }
+
+    if(trailer.ttl <= 1) {
+        stats.dropped_ttl++;
+        radioReturnPacket(packet);
+        return 1;
+    }
+
+    next_hop = meshGetNextHop(trailer.dest);
+    entry = dirQueryAddress(next_hop, netGetLocalPanID());
+
+    // Last hop to a node without mesh support gets a plain packet
+    if(next_hop == trailer.dest &&
+            (entry == NULL || !(entry->route_flags & ROUTE_FLAG_MESH))) {
+        setDataLength(packet, length);
+        paySetType(pld, trailer.type);
+        macSetSrc(packet, netGetLocalPanID(), trailer.origin);
+    } else {
+        trailer.ttl--;
+        trailer.hops++;
+        memcpy(trailer_data, &trailer, MESH_TRAILER_SIZE);
+        macSetSrc(packet, netGetLocalPanID(), netGetLocalAddress());
+    }
+
+    macSetDestAddr(packet, next_hop);
+    macSetDestPan(packet, netGetLocalPanID());
+
+    if(!txqSend(packet, NULL, NULL)) {
+        stats.dropped_tx++;
+        radioReturnPacket(packet);
+        return 1;
+    }
+    stats.forwarded++;
+    return 1;
+
+}
+
+void meshHandleAdvert(MacPacket packet) {
+
+    Payload pld;
+    DirEntry neighbour, entry;
+    MeshAdvertItem items;
+    unsigned int i, num_items, src_addr, pan, local_addr, link;
+    unsigned long cost;
+
+    if(!is_ready) { return; }
+
+    src_addr = macGetSrcAddr(packet);
+    pan = macGetSrcPan(packet);
+    local_addr = netGetLocalAddress();
+
+    // Link quality updates create entries for every sender
+    neighbour = dirQueryAddress(src_addr, pan);
+    if(neighbour == NULL) { return; }
+    neighbour->route_flags |= ROUTE_FLAG_MESH;
+    stats.adverts++;
+
+    pld = macGetPayload(packet);
+    items = (MeshAdvertItem) payGetData(pld);
+    num_items = payGetDataLength(pld)/sizeof(MeshAdvertItemStruct);
+    if(num_items == 0) { return; }
+    netUpdateLinkLoss(neighbour, items[0].seq);
+
+    link = linkCost(neighbour);
+    if(link == MESH_COST_INFINITE) { return; }
+
+    for(i = 0; i < num_items; i++) {
+
+        if(items[i].addr == local_addr) { continue; }
+
+        entry = dirQueryAddress(items[i].addr, pan);
+        if(entry == NULL) {
+            entry = dirAddNew();
+            if(entry == NULL) { continue; }
+            entry->address = items[i].addr;
+            entry->pan_id = pan;
+        }
+
+        cost = (unsigned long) items[i].cost + link;
+        // Routes through us are poison for the advertiser (split horizon)
+        if(items[i].next_hop == local_addr || items[i].hops >= MAX_HOPS ||
+                cost > MESH_COST_INFINITE) {
+            cost = MESH_COST_INFINITE;
+        }
+        updateRoute(entry, src_addr, (unsigned int) cost, items[i].hops + 1);
+
+    }
+
+}
+
+unsigned char meshGetInnerType(MacPacket packet) {
+
+    Payload pld;
+    MeshTrailerStruct trailer;
+    unsigned int length;
+
+    pld = macGetPayload(packet);
+    length = payGetDataLength(pld);
+    if(length < MESH_TRAILER_SIZE) { return payGetType(pld); }
+
+    memcpy(&trailer, payGetData(pld) + length - MESH_TRAILER_SIZE,
+            MESH_TRAILER_SIZE);
+    return trailer.type;
+
+}
+
+void meshGetStats(MeshStats dst, unsigned char clear) {
+
+    memcpy(dst, &stats, sizeof(MeshStatsStruct));
+    if(clear) {
+        memset(&stats, 0, sizeof(MeshStatsStruct));
+    }
+
+}
+
+void meshProcess(void) {
+
+    unsigned long now;
+
+    if(!is_ready || advert_period == 0) { return; }
+
+    now = sclockGetLocalTicks();
+    if((long)(now - next_advert) < 0) { return; }
+
+    // Defer rather than compete with traffic already queued
+    if(txqGetCredits() < ADVERT_RESERVE_CREDITS) { return; }
+
+    // Jitter between 3/4 and 5/4 of the period so neighbours do not collide
+    next_advert = now + advert_period - (advert_period >> 2)
+                    + (advert_period >> 16)*(unsigned long)rand();
+    sendAdvert();
+
+}
+
+// =========== Private Functions ===============================================
+
+static void setDataLength(MacPacket packet, unsigned int length) {
+
+    Payload pld;
+
+    pld = macGetPayload(packet);
+    pld->data_length = length;
+    packet->payload_length = length + PAYLOAD_HEADER_LENGTH;
+
+}
+
+// Returns 1 if (origin, id) was seen recently, otherwise records it
+static unsigned int checkSeen(unsigned int origin, unsigned char id) {
+
+    unsigned int i;
+
+    for(i = 0; i < SEEN_SIZE; i++) {
+        if(seen[i].origin == origin && seen[i].id == id) { return 1; }
+    }
+
+    seen[seen_head].origin = origin;
+    seen[seen_head].id = id;
+    seen_head = (seen_head + 1) % SEEN_SIZE;
+    return 0;
+
+}
+
+static unsigned int routeValid(DirEntry entry) {
+
+    if(entry->hops == 0) { return 0; }
+    return sclockGetLocalTicks() - entry->route_time < route_timeout;
+
+}
+
+static unsigned int searchAdvertised(DirEntry entry, void *args) {
+
+    if(entry == NULL) { return 0; }
+    return entry->pan_id == *((unsigned int*) args) && routeValid(entry);
+
+}
+
+// Expected transmission count scaled by HOP_COST
+static unsigned int linkCost(DirEntry entry) {
+
+    if(entry->quality < MIN_LINK_QUALITY) { return MESH_COST_INFINITE; }
+    return (HOP_COST*255UL)/entry->quality;
+
+}
+
+static void updateRoute(DirEntry entry, unsigned int via, unsigned int cost,
+                        unsigned char hops) {
+
+    unsigned int valid;
+
+    valid = routeValid(entry);
+
+    if(cost == MESH_COST_INFINITE) {
+        // Withdrawn by the current next hop
+        if(valid && entry->next_hop == via) { entry->hops = 0; }
+        return;
+    }
+
+    if(valid && entry->next_hop != via &&
+            (unsigned long) cost + COST_HYSTERESIS >= entry->route_cost) {
+        return;
+    }
+
+    entry->next_hop = via;
+    entry->route_cost = cost;
+    entry->hops = hops;
+    entry->route_time = sclockGetLocalTicks();
+
+}
+
+static void sendAdvert(void) {
+
+    MacPacket packet;
+    Payload pld;
+    MeshAdvertItem items;
+    DirEntry entries[MAX_ADVERT_ITEMS - 1];
+    unsigned int i, num_entries, pan;
+
+    pan = netGetLocalPanID();
+    num_entries = dirQueryN(&searchAdvertised, &pan, entries,
+                            MAX_ADVERT_ITEMS - 1);
+
+    packet = radioRequestPacket((num_entries + 1)*sizeof(MeshAdvertItemStruct));
+    if(packet == NULL) { return; }
+
+    macSetDestAddr(packet, NETWORK_BROADCAST_ADDR);
+    macSetDestPan(packet, pan);
+    pld = macGetPayload(packet);
+    paySetType(pld, CMD_ROUTE_ADVERT);
+    paySetStatus(pld, 0);
+
+    items = (MeshAdvertItem) payGetData(pld);
+    items[0].addr = netGetLocalAddress();
+    items[0].cost = 0;
+    items[0].next_hop = items[0].addr;
+    items[0].hops = 0;
+    items[0].seq = advert_seq++;
+
+    for(i = 0; i < num_entries; i++) {
+        items[i + 1].addr = entries[i]->address;
+        items[i + 1].cost = entries[i]->route_cost;
+        items[i + 1].next_hop = entries[i]->next_hop;
+        items[i + 1].hops = entries[i]->hops;
+        items[i + 1].seq = 0;
+    }
+
+    if(!txqSend(packet, NULL, NULL)) {
+        radioReturnPacket(packet);
+    }
+
+}
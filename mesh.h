@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Multi-hop Mesh Forwarding
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Mesh packets carry a trailer after the application data holding the
+ *    origin, final destination, sequence id, TTL and the original payload
+ *    type. Wrapping and unwrapping only change the payload length, so relays
+ *    forward the received packet in place without copying.
+ *  - Packets to a direct neighbour are sent unwrapped so that nodes without
+ *    mesh support, such as the basestation, still understand them.
+ *  - Routes are distance vector. Each node periodically broadcasts its route
+ *    table with costs derived from directory link quality. Routes learned
+ *    through a neighbour are refreshed by its adverts and expire otherwise.
+ *  - The trailer's send time and the latency statistics count units of
+ *    MESH_TIME_SHIFT global ticks, 64 ticks or about 0.1 ms. The 16 bit
+ *    send time wraps after about 6.7 s, so longer latencies alias.
+ *  - Adverts carry a sequence number. Gaps in it give the link loss rate,
+ *    since every neighbour is meant to receive every advert.
+ *  - Not interrupt safe. Call from the background loop only.
+ */
+
+#ifndef __MESH_H
+#define __MESH_H
+
+#include "mac_packet.h"
+#include "txq.h"
+
+#define MESH_TRAILER_SIZE       (10)
+#define MESH_TIME_SHIFT         (6)     // Latency unit is 64 ticks
+#define MESH_COST_INFINITE      (0xFFFF)
+
+typedef struct {
+    unsigned int originated;    // Packets wrapped and sent by this node
+    unsigned int forwarded;     // Packets relayed towards their destination
+    unsigned int delivered;     // Packets unwrapped at their destination
+    unsigned int dropped_dup;   // Duplicates suppressed
+    unsigned int dropped_ttl;   // Packets whose TTL ran out
+    unsigned int dropped_tx;    // Packets refused by the transmit queue
+    unsigned int adverts;       // Route adverts received
+    unsigned int total_hops;    // Sum of hop counts over delivered packets
+    unsigned long total_latency;// Origin to delivery, MESH_TIME_SHIFT units
+    unsigned int max_latency;   // MESH_TIME_SHIFT units
+} MeshStatsStruct;
+
+typedef MeshStatsStruct* MeshStats;
+
+/**
+ * Set up mesh module
+ */
+void meshSetup(void);
+
+/**
+ * Set the route advertisement period
+ * @param ticks - Period in system clock ticks, 0 to stop advertising
+ */
+void meshSetAdvertPeriod(unsigned long ticks);
+
+/**
+ * Allocate a packet with room for the mesh trailer
+ * @param data_size - Application data size
+ * @return Packet with data length data_size, or NULL if none available
+ */
+MacPacket meshRequestPacket(unsigned int data_size);
+
+/**
+ * Send a packet from meshRequestPacket() towards a destination in the same
+ * PAN. Never blocks.
+ * @param packet - Packet with its payload type and data filled in
+ * @param dest_addr - Final destination address
+ * @param callback - Transmit queue completion callback, or NULL
+ * @param args - Argument passed to callback
+ * @return 1 if queued, 0 if out of credits. On failure the caller still owns
+ *  the packet and should return it with radioReturnPacket().
+ */
+unsigned int meshSend(MacPacket packet, unsigned int dest_addr,
+                        TxqCallback callback, void *args);
+
+/**
+ * Next hop towards a destination. Destinations without a route are assumed
+ * to be direct neighbours.
+ * @param dest_addr - Final destination address
+ * @return Next hop address
+ */
+unsigned int meshGetNextHop(unsigned int dest_addr);
+
+/**
+ * Handle a received packet before command dispatch. Packets for other nodes
+ * are forwarded or dropped, packets for this node are unwrapped in place so
+ * that their source becomes the origin.
+ * @param packet - Received packet
+ * @return 1 if the packet was consumed, 0 if it should be dispatched
+ */
+unsigned int meshProcessPacket(MacPacket packet);
+
+/**
+ * Update routes from a neighbour's advertisement
+ * @param packet - CMD_ROUTE_ADVERT packet
+ */
+void meshHandleAdvert(MacPacket packet);
+
+/**
+ * Original payload type of a wrapped packet
+ */
+unsigned char meshGetInnerType(MacPacket packet);
+
+/**
+ * Copy out forwarding counters
+ * @param stats - Destination structure
+ * @param clear - Reset counters after copying if non-zero
+ */
+void meshGetStats(MeshStats stats, unsigned char clear);
+
+/**
+ * Background tasks. Broadcasts route adverts when due.
+ */
+void meshProcess(void);
+
+#endif // __MESH_H
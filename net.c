@@ -40,7 +40,7 @@
 * Notes:
 *
 * TODO:
-*	Implement robust multi-hop networking
+*	Multi-hop addressing (forwarding is handled by mesh module)
 */
 
 // ==== REFERENCES ==========================================
@@ -48,6 +48,7 @@
 #include "directory.h"
 #include "radio.h"
 #include "telemetry.h"
+#include "txq.h"
 
 #include "cmd_const.h"
 #include "utils.h"
@@ -67,6 +68,13 @@
 #define DEFAULT_BASE_PAN            (0x1005)
 #define DEFAULT_BASE_CHANNEL        (0x12)
 
+// Link estimation
+#define LINK_AVG_SHIFT              (3)     // RSSI/ED average weight 1/8
+#define LINK_LOSS_SHIFT             (4)     // Loss average weight 1/16
+#define LINK_MAX_GAP                (16)    // Larger gaps are treated as resets
+#define LINK_RSSI_FLOOR             (6)     // RSSI where quality starts to fall
+#define LINK_RSSI_SPAN              (12)
+
 // ==== STATIC VARIABLES ====================================
 // Local assigned parameters
 static unsigned int localAddress;
@@ -86,6 +94,7 @@ static unsigned char attempts_exceeded, address_received;
 // Send methods
 void netSendRequest(void);
 void netSendAccept(long);
+static void updateQuality(DirEntry entry);
 
 // ==== FUNCTION BODIES =====================================
 // Setup the network module
@@ -159,6 +168,67 @@ void netRequestAddress(void) {
     
 }
 
+void netUpdateLinkQuality(MacPacket packet) {
+
+    DirEntry entry;
+    RadioStatus radio_stat;
+    unsigned int addr, pan;
+
+    addr = macGetSrcAddr(packet);
+    pan = macGetSrcPan(packet);
+
+    entry = dirQueryAddress(addr, pan);
+    if(entry == NULL) {
+        entry = dirAddNew();
+        if(entry == NULL) { return; }
+        entry->address = addr;
+        entry->pan_id = pan;
+    }
+
+    // Readings belong to the most recent frame, which is normally this one
+    // since the RX queue is drained every background loop
+    radioGetStatus(&radio_stat);
+    entry->timestamp = sclockGetLocalTicks();   // Last contact
+
+    if(entry->rx_count == 0) {
+        entry->rssi = (unsigned int) radio_stat.last_rssi << 8;
+        entry->ed = (unsigned int) radio_stat.last_ed << 8;
+    } else {
+        entry->rssi += (((long)radio_stat.last_rssi << 8) - (long)entry->rssi) >> LINK_AVG_SHIFT;
+        entry->ed += (((long)radio_stat.last_ed << 8) - (long)entry->ed) >> LINK_AVG_SHIFT;
+    }
+    entry->rx_count++;
+
+    updateQuality(entry);
+
+}
+
+void netUpdateLinkLoss(DirEntry entry, unsigned char seq) {
+
+    unsigned char gap;
+
+    if(entry->advert_count == 0) {
+        entry->loss = 0;
+        gap = 0;
+    } else {
+        gap = seq - entry->last_seq - 1;
+        if(gap > LINK_MAX_GAP) { gap = 0; } // Duplicate, reorder or reboot
+    }
+
+    // One loss sample per missing sequence number, then one success
+    entry->lost_count += gap;
+    while(gap--) {
+        entry->loss += (0xFFFF - entry->loss) >> LINK_LOSS_SHIFT;
+    }
+    entry->loss -= entry->loss >> LINK_LOSS_SHIFT;
+
+    entry->last_seq = seq;
+    entry->advert_count++;
+
+    updateQuality(entry);
+
+}
+
 void netHandleOffer(MacPacket packet) {
     
     Payload pld;    
@@ -204,6 +274,22 @@ void netHandleAccept(MacPacket packet) {
 
 // =========== Private Functions ==============================================
 
+// Delivery ratio, derated when RSSI approaches the sensitivity floor
+static void updateQuality(DirEntry entry) {
+
+    unsigned int quality, rssi;
+
+    quality = 255 - (entry->loss >> 8);
+    rssi = entry->rssi >> 8;
+    if(rssi < LINK_RSSI_FLOOR) {
+        quality = 0;
+    } else if(rssi < LINK_RSSI_FLOOR + LINK_RSSI_SPAN) {
+        quality = quality*(rssi - LINK_RSSI_FLOOR)/LINK_RSSI_SPAN;
+    }
+    entry->quality = (unsigned char) quality;
+
+}
+
 // Broadcast a request for an address
 // Note that the radio needs to be set to the appropriate PAN
 // TODO: Have network setup set radio to appropriate PAN!
@@ -221,7 +307,9 @@ void netSendRequest(void) {
     paySetStatus(pld, 0);
     paySetType(pld, CMD_ADDRESS_REQUEST);
 
-    while(!radioEnqueueTxPacket(request_packet));
+    if(!txqSend(request_packet, NULL, NULL)) {
+        radioReturnPacket(request_packet);
+    }
 
 }
 
@@ -243,6 +331,8 @@ void netSendAccept(long offerID) {
     paySetStatus(pld, 0);
     paySetType(pld, CMD_ADDRESS_ACCEPT);
 
-    while(!radioEnqueueTxPacket(accept_packet));
+    if(!txqSend(accept_packet, NULL, NULL)) {
+        radioReturnPacket(accept_packet);
+    }
 
 }
@@ -45,6 +45,7 @@
 #define __NETWORK_H
 
 #include "mac_packet.h"
+#include "directory.h"
 
 #define NETWORK_BASESTATION_CHANNEL			(0x15)
 #define NETWORK_BASESTATION_PAN_ID			(0x1001)
@@ -72,6 +73,23 @@ unsigned int netGetBasePanID(void);
 void netRequestAddress(void);
 unsigned char netAddressReceived(void);
 
+/**
+ * Update the signal strength of a packet's sender. Unknown senders are
+ * added to the directory.
+ * @param packet - Received packet
+ */
+void netUpdateLinkQuality(MacPacket packet);
+
+/**
+ * Update the loss estimate of a link from the sequence number of a received
+ * route advert. Adverts are broadcast, so unlike MAC sequence numbers their
+ * gaps count no frames that were sent to other nodes. Links that never
+ * advertise keep a loss of 0 and are rated by signal strength alone.
+ * @param entry - Sender of the advert
+ * @param seq - Advert sequence number
+ */
+void netUpdateLinkLoss(DirEntry entry, unsigned char seq);
+
 void netHandleOffer(MacPacket packet);
 void netHandleRequest(MacPacket packet);
 void netHandleAccept(MacPacket packet);
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Attitude History Ring
+ *
+ * v.beta
+ */
+
+#include "pose_history.h"
+#include "sys_clock.h"
+
+#include <string.h>
+
+#define GUARD_SLOTS             (2)     // Oldest slots the writer may reach
+
+typedef struct {
+    unsigned long time;
+    Quaternion pose;
+} PoseSampleStruct;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static unsigned int decimate_count;
+static volatile unsigned int head, count;
+
+static PoseSampleStruct history[PHIST_SIZE];
+
+// =========== Public Functions ================================================
+
+void phistSetup(void) {
+
+    phistReset();
+    is_ready = 1;
+
+}
+
+void phistReset(void) {
+
+    head = 0;
+    count = 0;
+    decimate_count = 0;
+
+}
+
+void phistRecord(Quaternion *pose) {
+
+    PoseSampleStruct *sample;
+
+    if(!is_ready) { return; }
+
+    if(++decimate_count < PHIST_DECIMATION) { return; }
+    decimate_count = 0;
+
+    // Publish the slot only after it is complete
+    sample = &history[head];
+    sample->time = sclockGetGlobalTicks();
+    quatCopy(&sample->pose, pose);
+    head = (head + 1) % PHIST_SIZE;
+    if(count < PHIST_SIZE) { count++; }
+
+}
+
+unsigned int phistGetQuat(unsigned long time, Quaternion *pose) {
+
+    PoseSampleStruct older, newer;
+    unsigned int i, idx, newest, usable;
+    float frac, sign;
+
+    usable = count;
+    newest = (head + PHIST_SIZE - 1) % PHIST_SIZE;
+    if(usable == 0) { return 0; }
+    if(usable > PHIST_SIZE - GUARD_SLOTS) { usable = PHIST_SIZE - GUARD_SLOTS; }
+
+    // Walk back to the newest sample not after the requested time
+    for(i = 0; i < usable; i++) {
+        idx = (newest + PHIST_SIZE - i) % PHIST_SIZE;
+        if((long)(time - history[idx].time) >= 0) { break; }
+    }
+
+    if(i == 0 || i == usable) {
+        idx = (i == 0) ? newest : (newest + PHIST_SIZE - usable + 1) % PHIST_SIZE;
+        quatCopy(pose, &history[idx].pose);
+        return 1;
+    }
+
+    memcpy(&older, &history[idx], sizeof(PoseSampleStruct));
+    memcpy(&newer, &history[(idx + 1) % PHIST_SIZE], sizeof(PoseSampleStruct));
+
+    // Normalized linear interpolation, samples are only a few ms apart
+    frac = (float)(time - older.time)/(float)(newer.time - older.time);
+    sign = (older.pose.w*newer.pose.w + older.pose.x*newer.pose.x +
+            older.pose.y*newer.pose.y + older.pose.z*newer.pose.z) < 0.0 ? -1.0 : 1.0;
+
+    pose->w = older.pose.w*(1.0 - frac) + sign*newer.pose.w*frac;
+    pose->x = older.pose.x*(1.0 - frac) + sign*newer.pose.x*frac;
+    pose->y = older.pose.y*(1.0 - frac) + sign*newer.pose.y*frac;
+    pose->z = older.pose.z*(1.0 - frac) + sign*newer.pose.z*frac;
+    quatNormalize(pose);
+    return 1;
+
+}
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Attitude History Ring
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - phistRecord() is called from the control interrupt and stores every
+ *    PHIST_DECIMATION'th pose stamped with the global clock.
+ *  - phistGetQuat() is called from the background and interpolates between
+ *    the two samples around the requested time. The oldest slots may be
+ *    overwritten while reading and are never used.
+ */
+
+#ifndef __POSE_HISTORY_H
+#define __POSE_HISTORY_H
+
+#include "quat.h"
+
+#define PHIST_SIZE              (32)
+#define PHIST_DECIMATION        (2)     // 150 Hz at 300 Hz control rate
+
+/**
+ * Set up pose history. The ring starts empty.
+ */
+void phistSetup(void);
+
+/**
+ * Clear recorded history
+ */
+void phistReset(void);
+
+/**
+ * Record the current pose. Call once per control iteration.
+ * @param pose - Current attitude
+ */
+void phistRecord(Quaternion *pose);
+
+/**
+ * Attitude at a past instant. Times after the newest sample return the
+ * newest sample, times before the history return the oldest usable sample.
+ * @param time - Global time in system clock ticks
+ * @param pose - Destination quaternion
+ * @return 1 if history was available, 0 if empty
+ */
+unsigned int phistGetQuat(unsigned long time, Quaternion *pose);
+
+#endif // __POSE_HISTORY_H
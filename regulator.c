@@ -72,6 +72,10 @@
 #include "bams.h"
 #include "utils.h"
 #include "ppbuff.h"
+#include "pose_history.h"
+#include "tilt_correct.h"
+#include "gyro_sampler.h"
+#include "journal.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -325,15 +329,25 @@ void rgltrRunController(void) {
 
     if(!is_ready) { return; }    
 
-    attEstimatePose();  // Update attitude estimate
+    // Timer 7 owns the gyro while sampling
+    if(gsampIsRunning()) {
+        gsampUpdate();      // Coning compensated integration
+        gsampCorrect();     // Accelerometer aiding
+    } else {
+        attEstimatePose();  // Update attitude estimate
+    }
 
     rateProcess();      // Update limited_reference
     slewProcess(&reference, &limited_reference); // Apply slew rate limiting
 
-    attGetQuat(&pose);
+    gsampGetQuat(&pose);
+    tiltUpdate();           // Take in background tilt measurements
+    tiltApply(&pose);       // External tilt aiding
+    phistRecord(&pose);     // Keep attitude for latency compensation
     calculateError(&error);    
     calculateOutputs(&error, &output);
     applyOutputs(&output);        
+    jrnlTick((unsigned char*) &output, sizeof(RegulatorOutput));
     
     if(is_logging) {
         logTrace(&error, &output);
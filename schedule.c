@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Timed Command Scheduler
+ *
+ * v.beta
+ */
+
+#include "schedule.h"
+#include "radio.h"
+#include "sys_clock.h"
+#include "timer.h"
+
+#include <string.h>
+
+#define FIRED_SIZE              (SCHED_MAX_ENTRIES + 1)
+
+typedef struct {
+    unsigned long time;
+    MacPacket packet;
+} SchedEntryStruct;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static SchedHandler fire;
+
+// Min-heap on time, shared with the control interrupt
+static SchedEntryStruct heap[SCHED_MAX_ENTRIES];
+static volatile unsigned int heap_size;
+
+// Fired packets awaiting return, written by the control interrupt
+static MacPacket fired[FIRED_SIZE];
+static volatile unsigned int fired_head, fired_tail;
+
+static volatile SchedStatsStruct stats;
+
+// =========== Function Stubs ==================================================
+static void siftUp(unsigned int i);
+static void siftDown(unsigned int i);
+static unsigned int isBefore(unsigned int a, unsigned int b);
+
+// =========== Public Functions ================================================
+
+void schedSetup(SchedHandler handler) {
+
+    fire = handler;
+    heap_size = 0;
+    fired_head = 0;
+    fired_tail = 0;
+    memset((void*) &stats, 0, sizeof(stats));
+    is_ready = 1;
+
+}
+
+unsigned int schedAdd(unsigned long time, MacPacket packet) {
+
+    unsigned int i;
+
+    if(!is_ready) { return 0; }
+
+    // Fired packets hold their slot until returned
+    DisableIntT5;
+    if(heap_size + (fired_head - fired_tail + FIRED_SIZE) % FIRED_SIZE
+        >= SCHED_MAX_ENTRIES) {
+        stats.rejected++;
+        EnableIntT5;
+        return 0;
+    }
+    if((long)(time - sclockGetGlobalTicks()) < 0) { stats.late++; }
+    i = heap_size++;
+    heap[i].time = time;
+    heap[i].packet = packet;
+    siftUp(i);
+    stats.queued++;
+    EnableIntT5;
+    return 1;
+
+}
+
+void schedFlush(void) {
+
+    MacPacket packet;
+
+    if(!is_ready) { return; }
+
+    while(1) {
+        DisableIntT5;
+        if(heap_size == 0) {
+            EnableIntT5;
+            break;
+        }
+        packet = heap[0].packet;
+        heap[0] = heap[--heap_size];
+        siftDown(0);
+        EnableIntT5;
+        radioReturnPacket(packet);
+    }
+
+}
+
+void schedRun(void) {
+
+    unsigned long now;
+    MacPacket packet;
+
+    if(!is_ready || heap_size == 0) { return; }
+
+    now = sclockGetGlobalTicks();
+    while(heap_size > 0 && (long)(heap[0].time - now) <= 0) {
+        packet = heap[0].packet;
+        heap[0] = heap[--heap_size];
+        siftDown(0);
+
+        fire(packet);
+        stats.fired++;
+        fired[fired_head] = packet;
+        fired_head = (fired_head + 1) % FIRED_SIZE;
+    }
+
+}
+
+void schedProcess(void) {
+
+    while(fired_tail != fired_head) {
+        radioReturnPacket(fired[fired_tail]);
+        fired_tail = (fired_tail + 1) % FIRED_SIZE;
+    }
+
+}
+
+void schedGetStats(SchedStats dst) {
+
+    DisableIntT5;
+    memcpy(dst, (void*) &stats, sizeof(SchedStatsStruct));
+    EnableIntT5;
+
+}
+
+// =========== Private Functions ===============================================
+
+// Wraparound safe comparison of entry times
+static unsigned int isBefore(unsigned int a, unsigned int b) {
+
+    return (long)(heap[a].time - heap[b].time) < 0;
+
+}
+
+static void siftUp(unsigned int i) {
+
+    SchedEntryStruct temp;
+    unsigned int parent;
+
+    while(i > 0) {
+        parent = (i - 1) >> 1;
+        if(!isBefore(i, parent)) { break; }
+        temp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = temp;
+        i = parent;
+    }
+
+}
+
+static void siftDown(unsigned int i) {
+
+    SchedEntryStruct temp;
+    unsigned int child, size;
+
+    size = heap_size;
+    while(1) {
+        child = 2*i + 1;
+        if(child >= size) { break; }
+        if(child + 1 < size && isBefore(child + 1, child)) { child++; }
+        if(!isBefore(child, i)) { break; }
+        temp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = temp;
+        i = child;
+    }
+
+}
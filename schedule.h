@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Timed Command Scheduler
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Packets are held in a min-heap ordered by global time, with slots
+ *    taken from a static pool. schedRun() is called from the control
+ *    interrupt and fires every packet due by the current tick, so
+ *    scheduled actions land on the same control tick across the swarm
+ *    regardless of radio queueing.
+ *  - Fired packets are returned to the radio pool by schedProcess() in the
+ *    background. The handler runs in interrupt context and must not send
+ *    packets or block.
+ *  - Packets whose time has already passed fire on the next tick and are
+ *    counted late.
+ */
+
+#ifndef __SCHEDULE_H
+#define __SCHEDULE_H
+
+#include "mac_packet.h"
+
+#define SCHED_MAX_ENTRIES       (8)
+
+// Called from the control interrupt when a packet is due
+typedef void (*SchedHandler)(MacPacket packet);
+
+typedef struct {
+    unsigned int queued;
+    unsigned int fired;
+    unsigned int late;      // Scheduled for a time already passed
+    unsigned int rejected;  // Pool full
+} SchedStatsStruct;
+
+typedef SchedStatsStruct* SchedStats;
+
+/**
+ * Set up the scheduler
+ * @param handler - Function called with each due packet
+ */
+void schedSetup(SchedHandler handler);
+
+/**
+ * Schedule a packet. Call from the background only.
+ * @param time - Global time in system clock ticks
+ * @param packet - Packet to fire. The scheduler takes ownership on success.
+ * @return 1 if scheduled, 0 if the pool is full
+ */
+unsigned int schedAdd(unsigned long time, MacPacket packet);
+
+/**
+ * Drop all pending packets. Call from the background only.
+ */
+void schedFlush(void);
+
+/**
+ * Fire all packets due by now. Call once per control tick from the
+ * control interrupt.
+ */
+void schedRun(void);
+
+/**
+ * Return fired packets to the radio pool. Call regularly from the
+ * background.
+ */
+void schedProcess(void);
+
+/**
+ * Read the scheduler counters
+ * @param stats - Struct to populate
+ */
+void schedGetStats(SchedStats stats);
+
+#endif // __SCHEDULE_H
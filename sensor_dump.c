@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Raw IMU Flash Recorder
+ *
+ * v.beta
+ */
+
+#include "sensor_dump.h"
+#include "gyro_sampler.h"
+#include "gyro.h"
+#include "xl.h"
+#include "dfmem.h"
+#include "sys_clock.h"
+#include "timer.h"
+
+#include <string.h>
+
+#define TICKS_PER_SEC           (625000)
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static volatile unsigned char is_recording = 0;
+
+static SdumpPageStruct pages[SDUMP_NUM_BUFFERS];
+static DfmemGeometryStruct mem_geo;
+static unsigned int mem_page_pos, mem_buff_index;
+
+// Buffer ring, filled by the sampling interrupt at head and written at tail
+static volatile unsigned int head, tail, num_full;
+static volatile unsigned char filling;
+static volatile unsigned int seq, gap;
+static unsigned long sample_ticks, last_time;
+
+static volatile SdumpStatsStruct stats;
+
+// =========== Function Stubs ==================================================
+static void finishPage(void);
+
+// =========== Public Functions ================================================
+
+void sdumpSetup(unsigned int rate) {
+
+    dfmemGetGeometryParams(&mem_geo);
+    sample_ticks = TICKS_PER_SEC/rate;
+    memset((void*) &stats, 0, sizeof(stats));
+    is_recording = 0;
+    is_ready = 1;
+
+}
+
+unsigned int sdumpStart(void) {
+
+    unsigned int i;
+
+    if(!is_ready || is_recording) { return 0; }
+    if(!gsampIsRunning()) { return 0; }
+    if(mem_geo.bytes_per_page < sizeof(SdumpPageStruct)) { return 0; }
+
+    mem_page_pos = SDUMP_START_PAGE;
+    mem_buff_index = 0;
+    i = mem_page_pos;
+    while(i < mem_geo.max_pages) {
+        dfmemEraseSector(i);
+        i += mem_geo.pages_per_sector;
+    }
+    while(!dfmemIsReady());
+
+    DisableIntT7;
+    head = 0;
+    tail = 0;
+    num_full = 0;
+    filling = 0;
+    seq = 0;
+    gap = 0;
+    memset((void*) &stats, 0, sizeof(stats));
+    is_recording = 1;
+    stats.recording = 1;
+    EnableIntT7;
+    return 1;
+
+}
+
+void sdumpStop(void) {
+
+    DisableIntT7;
+    if(filling) { finishPage(); }
+    is_recording = 0;
+    stats.recording = 0;
+    if(gsampIsRunning()) { EnableIntT7; }
+
+}
+
+unsigned char sdumpIsRecording(void) {
+
+    return is_recording;
+
+}
+
+void sdumpSample(void) {
+
+    unsigned long now;
+    SdumpPageStruct *page;
+    SdumpSampleStruct *sample;
+
+    if(!is_recording) { return; }
+
+    now = sclockGetLocalTicks();
+
+    if(!filling) {
+        if(num_full >= SDUMP_NUM_BUFFERS) {
+            gap++;
+            stats.dropped++;
+            last_time = now;
+            return;
+        }
+        page = &pages[head];
+        page->time = now;
+        page->seq = seq++;
+        page->gap = gap;
+        page->late = 0;
+        page->num_samples = 0;
+        gap = 0;
+        filling = 1;
+    } else {
+        page = &pages[head];
+        if(now - last_time > sample_ticks + (sample_ticks >> 1)) {
+            page->late++;
+            stats.late++;
+        }
+    }
+    last_time = now;
+
+    sample = &page->samples[page->num_samples];
+    gyroGetIntXYZ(sample->gyro);
+    xlGetIntXYZ(sample->xl);
+    stats.samples++;
+
+    if(++page->num_samples >= SDUMP_PAGE_SAMPLES) { finishPage(); }
+
+}
+
+void sdumpProcess(void) {
+
+    if(!is_ready || num_full == 0) { return; }
+
+    if(mem_page_pos < mem_geo.max_pages) {
+        // Region was erased at start
+        dfmemWriteBuffer((unsigned char*) &pages[tail], sizeof(SdumpPageStruct),
+                    0, mem_buff_index);
+        dfmemWriteBuffer2MemoryNoErase(mem_page_pos, mem_buff_index);
+        mem_buff_index ^= 0x01;
+        mem_page_pos++;
+        stats.pages++;
+    } else if(is_recording) {
+        sdumpStop();    // Flash full, remaining buffers are discarded
+    }
+
+    tail = (tail + 1) % SDUMP_NUM_BUFFERS;
+    DisableIntT7;
+    num_full--;
+    if(gsampIsRunning()) { EnableIntT7; }
+
+}
+
+void sdumpGetStats(SdumpStats dst, unsigned char clear) {
+
+    DisableIntT7;
+    memcpy(dst, (void*) &stats, sizeof(SdumpStatsStruct));
+    if(clear) {
+        stats.samples = 0;
+        stats.dropped = 0;
+        stats.late = 0;
+        stats.pages = 0;
+        stats.max_pending = 0;
+    }
+    if(gsampIsRunning()) { EnableIntT7; }
+
+}
+
+// =========== Private Functions ===============================================
+
+// Hand the page being filled to the background writer. Interrupt context or
+// Timer 7 masked.
+static void finishPage(void) {
+
+    head = (head + 1) % SDUMP_NUM_BUFFERS;
+    num_full++;
+    if(num_full > stats.max_pending) { stats.max_pending = num_full; }
+    filling = 0;
+
+}
@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Raw IMU Flash Recorder
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Raw 16 bit gyro and accelerometer readings are recorded at the gyro
+ *    sampler rate for vibration analysis. sdumpSample() is called by the
+ *    sampling interrupt and packs readings into RAM page buffers.
+ *    sdumpProcess() writes full pages to flash from the background.
+ *  - Each page starts with a header carrying the time of its first sample
+ *    and the samples dropped before it. Samples within a page are evenly
+ *    spaced at the sampling period.
+ *  - When no page buffer is free, samples are dropped and counted. Samples
+ *    that arrive more than 1.5 periods after the last one are counted late.
+ *  - Recording shares the flash log region with the telemetry logger. Run
+ *    one at a time.
+ */
+
+#ifndef __SENSOR_DUMP_H
+#define __SENSOR_DUMP_H
+
+#define SDUMP_START_PAGE        (0x80)
+#define SDUMP_PAGE_SAMPLES      (43)    // Fills a 528 byte page
+#define SDUMP_NUM_BUFFERS       (3)
+
+typedef struct {
+    int gyro[3];            // Raw gyro counts
+    int xl[3];              // Raw accelerometer counts
+} SdumpSampleStruct;
+
+typedef struct {
+    unsigned long time;     // (4) Local ticks at the first sample
+    unsigned int seq;       // (2) Page sequence number
+    unsigned int gap;       // (2) Samples dropped just before this page
+    unsigned int late;      // (2) Late samples in this page
+    unsigned int num_samples; // (2) Valid samples
+    SdumpSampleStruct samples[SDUMP_PAGE_SAMPLES]; // (516)
+} SdumpPageStruct;
+
+typedef struct {
+    unsigned long samples;  // Samples recorded
+    unsigned long dropped;  // Samples lost to full buffers
+    unsigned int late;      // Late samples
+    unsigned int pages;     // Pages written to flash
+    unsigned int max_pending; // Most full buffers waiting for flash
+    unsigned char recording; // 1 while recording
+} SdumpStatsStruct;
+
+typedef SdumpStatsStruct* SdumpStats;
+
+/**
+ * Set up the recorder
+ * @param rate - Sampling rate in Hz
+ */
+void sdumpSetup(unsigned int rate);
+
+/**
+ * Erase the log region and begin recording. Blocks during the erase.
+ * @return 1 if started, 0 if the gyro sampler is not running
+ */
+unsigned int sdumpStart(void);
+
+/**
+ * Stop recording. Buffered samples are still written by sdumpProcess().
+ */
+void sdumpStop(void);
+
+/**
+ * Returns 1 while recording, 0 otherwise
+ */
+unsigned char sdumpIsRecording(void);
+
+/**
+ * Record the latest gyro and accelerometer readings. Call from the
+ * sampling interrupt after both sensors have been read.
+ */
+void sdumpSample(void);
+
+/**
+ * Write full page buffers to flash. Call regularly from the background.
+ */
+void sdumpProcess(void);
+
+/**
+ * Read and optionally clear the recorder counters
+ * @param stats - Struct to populate
+ * @param clear - Reset counters after reading if nonzero
+ */
+void sdumpGetStats(SdumpStats stats, unsigned char clear);
+
+#endif // __SENSOR_DUMP_H
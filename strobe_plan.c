@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Swarm Strobe Slot Planner
+ *
+ * v.beta
+ */
+
+#include "strobe_plan.h"
+#include "lstrobe.h"
+#include "directory.h"
+#include "net.h"
+#include "sys_clock.h"
+#include "cam.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAN_PERIOD           (625000)    // 1 s
+#define PERIOD_TOLERANCE_SHIFT  (8)         // Same period within 1/256
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0, is_dirty, is_applied;
+static unsigned long next_plan;
+static SplanStruct applied;
+static DirEntryStruct self;     // Own camera timing, tracked like a peer
+
+// =========== Function Stubs ==================================================
+static DirEntry makePlan(Splan plan);
+static unsigned long widestGap(DirEntry ref, DirEntry *cams, unsigned int num,
+                        unsigned long *gap, unsigned char *num_used);
+static unsigned int searchFresh(DirEntry entry, void *args);
+static unsigned int planChanged(Splan plan);
+
+// =========== Public Functions ================================================
+
+void splanSetup(void) {
+
+    memset(&applied, 0, sizeof(SplanStruct));
+    is_dirty = 1;
+    is_applied = 0;
+    next_plan = sclockGetLocalTicks();
+    is_ready = 1;
+
+}
+
+void splanInvalidate(void) {
+
+    is_dirty = 1;
+
+}
+
+void splanProcess(void) {
+
+    SplanStruct plan;
+    DirEntry ref;
+    unsigned long now;
+
+    if(!is_ready) { return; }
+
+    now = sclockGetLocalTicks();
+    if(!is_dirty && (long)(now - next_plan) < 0) { return; }
+    is_dirty = 0;
+    next_plan = now + REPLAN_PERIOD;
+
+    ref = makePlan(&plan);
+    if(ref == NULL || !planChanged(&plan)) { return; }
+
+    if(!is_applied) { lstrobeSetId(netGetLocalAddress()); }
+    lstrobeSetPhase(plan.offset);
+    if(!lstrobeTrack(ref)) { return; }
+    memcpy(&applied, &plan, sizeof(SplanStruct));
+    is_applied = 1;
+
+}
+
+void splanGetPlan(Splan plan) {
+
+    memcpy(plan, &applied, sizeof(SplanStruct));
+
+}
+
+// =========== Private Functions ===============================================
+
+// Returns the reference camera, NULL if no camera is known
+static DirEntry makePlan(Splan plan) {
+
+    DirEntry entries[SPLAN_MAX_ENTRIES], cams[SPLAN_MAX_ENTRIES + 1], ref;
+    LStrobeParamStruct params;
+    CamParamStruct cam;
+    unsigned int i, num, num_cams, rank, others, local;
+    unsigned long start, flash, width;
+
+    memset(plan, 0, sizeof(SplanStruct));
+
+    num = dirQueryN(&searchFresh, NULL, entries, SPLAN_MAX_ENTRIES);
+    local = netGetLocalAddress();
+
+    // Own camera takes part like any other, so every bird sees the same set
+    camGetParams(&cam);
+    self.address = local;
+    self.frame_period = cam.frame_period;
+    self.frame_start = cam.frame_start;
+
+    // Rank beacons by address, this bird included
+    rank = 0;
+    others = 0;
+    num_cams = 0;
+    ref = NULL;
+    if(self.frame_period != 0) {
+        cams[num_cams++] = &self;
+        ref = &self;
+    }
+    for(i = 0; i < num; i++) {
+        if(entries[i]->address == local) { continue; }
+        others++;
+        if(entries[i]->address < local) { rank++; }
+        if(entries[i]->frame_period == 0) { continue; }
+        cams[num_cams++] = entries[i];
+        if(ref == NULL || entries[i]->address < ref->address) {
+            ref = entries[i];
+        }
+    }
+    plan->num_beacons = others + 1;
+    plan->slot = rank % LSTROBE_FRAMES_PER_FLASH;
+    plan->sub_slot = rank / LSTROBE_FRAMES_PER_FLASH;
+    plan->num_sub_slots = (plan->num_beacons + LSTROBE_FRAMES_PER_FLASH - 1)
+                            / LSTROBE_FRAMES_PER_FLASH;
+
+    if(ref == NULL) { return NULL; }
+
+    // Beacons sharing a frame split the gap, each flash centered in its
+    // part. Positions are measured from the reference frame start.
+    lstrobeGetParam(&params);
+    flash = (unsigned long) params.on_time << 2;    // Timer 3 counts to ticks
+    start = widestGap(ref, cams, num_cams, &plan->gap, &plan->num_cameras);
+    width = plan->gap/plan->num_sub_slots;
+    start += plan->sub_slot*width;
+    if(width > flash) { start += (width - flash) >> 1; }
+    start %= ref->frame_period;
+
+    plan->ref_addr = ref->address;
+    plan->frame_period = ref->frame_period;
+    plan->offset = plan->slot*ref->frame_period + start;
+    return ref;
+
+}
+
+// Frame boundaries of matching cameras relative to the reference frame
+// start. Returns the start of the widest gap between them.
+static unsigned long widestGap(DirEntry ref, DirEntry *cams, unsigned int num,
+                        unsigned long *gap, unsigned char *num_used) {
+
+    unsigned long period, tolerance, bounds[SPLAN_MAX_ENTRIES + 1], bound, width;
+    unsigned long diff, best_start;
+    unsigned int i, j, count;
+    long rel;
+
+    period = ref->frame_period;
+    tolerance = period >> PERIOD_TOLERANCE_SHIFT;
+
+    // Insertion sort, the list is short
+    count = 0;
+    for(i = 0; i < num; i++) {
+        diff = cams[i]->frame_period > period ?
+            cams[i]->frame_period - period : period - cams[i]->frame_period;
+        if(diff > tolerance) { continue; }
+        rel = (long)(cams[i]->frame_start - ref->frame_start) % (long)period;
+        bound = rel < 0 ? (unsigned long) rel + period : (unsigned long) rel;
+        for(j = count; j > 0 && bounds[j - 1] > bound; j--) {
+            bounds[j] = bounds[j - 1];
+        }
+        bounds[j] = bound;
+        count++;
+    }
+    *num_used = count;
+
+    // Gap after each boundary, the last wraps to the first
+    *gap = 0;
+    best_start = 0;
+    for(i = 0; i < count; i++) {
+        if(i + 1 < count) {
+            width = bounds[i + 1] - bounds[i];
+        } else {
+            width = bounds[0] + period - bounds[i];
+        }
+        if(width > *gap) {
+            *gap = width;
+            best_start = bounds[i];
+        }
+    }
+    return best_start;
+
+}
+
+static unsigned int searchFresh(DirEntry entry, void *args) {
+
+    (void) args;
+    if(entry == NULL) { return 0; }
+    if(entry->pan_id != netGetLocalPanID()) { return 0; }
+    return sclockGetLocalTicks() - entry->timestamp < SPLAN_STALE_TIME;
+
+}
+
+static unsigned int planChanged(Splan plan) {
+
+    unsigned long shift;
+
+    if(!is_applied) { return 1; }
+    if(!lstrobeIsTracking()) { return 1; }  // Strobe dropped the camera
+    if(plan->ref_addr != applied.ref_addr) { return 1; }
+    if(plan->slot != applied.slot) { return 1; }
+    if(plan->sub_slot != applied.sub_slot) { return 1; }
+
+    shift = plan->offset > applied.offset ?
+        plan->offset - applied.offset : applied.offset - plan->offset;
+    return shift > SPLAN_SHIFT_TOLERANCE;
+
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Swarm Strobe Slot Planner
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Every bird runs the same plan over its directory, so no negotiation is
+ *    needed. The camera with the lowest address is the timing reference,
+ *    and the strobe is phase-locked to it.
+ *  - Each strobe cycle has LSTROBE_FRAMES_PER_FLASH frames. Beacons are
+ *    ranked by address and flash in frame (rank mod frames), so a camera
+ *    knows which frame each beacon lights.
+ *  - Within the frame, the flash goes in the widest gap between the frame
+ *    boundaries of all cameras on the reference period. A flash there
+ *    falls entirely inside one exposure of every such camera. Cameras on
+ *    other periods drift and are ignored.
+ *  - With more beacons than frames, the beacons sharing a frame (rank div
+ *    frames) split the gap into equal sub-slots and center their flash in
+ *    their own one. Flashes only overlap when a sub-slot is narrower than
+ *    the flash.
+ *  - The plan is recomputed when camera parameters arrive and periodically.
+ *    The strobe is only moved when the slot or reference changes, or the
+ *    flash position shifts by more than SPLAN_SHIFT_TOLERANCE.
+ *  - Entries not heard from in SPLAN_STALE_TIME are left out.
+ */
+
+#ifndef __STROBE_PLAN_H
+#define __STROBE_PLAN_H
+
+#define SPLAN_MAX_ENTRIES       (20)
+#define SPLAN_SHIFT_TOLERANCE   (313)       // 0.5 ms
+#define SPLAN_STALE_TIME        (6250000)   // 10 s
+
+typedef struct {
+    unsigned int ref_addr;      // Reference camera, 0 if none
+    unsigned long frame_period; // Reference frame period in ticks
+    unsigned long offset;       // Strobe start after the first frame start
+    unsigned long gap;          // Width of the chosen boundary gap in ticks
+    unsigned char slot;         // Frame of the cycle this bird flashes in
+    unsigned char sub_slot;     // Part of the gap within that frame
+    unsigned char num_sub_slots; // Parts the gap is split into
+    unsigned char num_beacons;  // Beacons ranked, including this bird
+    unsigned char num_cameras;  // Cameras on the reference period
+} SplanStruct;
+
+typedef SplanStruct* Splan;
+
+/**
+ * Set up the planner
+ */
+void splanSetup(void);
+
+/**
+ * Request a replan on the next call to splanProcess(), e.g. after camera
+ * parameters change
+ */
+void splanInvalidate(void);
+
+/**
+ * Replan if requested or due and move the strobe if the plan changed.
+ * Call regularly from the background.
+ */
+void splanProcess(void);
+
+/**
+ * Currently applied plan
+ * @param plan - Struct to populate
+ */
+void splanGetPlan(Splan plan);
+
+#endif // __STROBE_PLAN_H
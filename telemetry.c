@@ -46,18 +46,34 @@
 #include "mac_packet.h"
 #include "payload.h"
 #include "regulator.h"
-#include "attitude.h"
+#include "gyro_sampler.h"
 #include "cmd_const.h"
 #include "dfmem.h"
 #include "led.h"
 #include "utils.h"
 #include "pbuff.h"
+#include "txq.h"
+#include "mesh.h"
+#include "aggregate.h"
+#include "directory.h"
+#include "behavior.h"
+#include "cam.h"
 
 #include <string.h>
 
 #define DEFAULT_START_PAGE      (0x80)
 #define TELEM_BUFF_SIZE         (5)
 #define DEFAULT_SUBSAMPLE       (1)
+#define STREAM_MIN_CREDITS      (8)     // Stop streaming below this many TX credits
+
+// Adaptive streaming
+#define STREAM_BASE_PERIOD      (12500)     // 20 ms (625 ticks/ms)
+#define STREAM_MAX_PERIOD       (625000)    // 1 s
+#define STREAM_MAX_PACK         (4)         // Compact samples per packet
+#define STREAM_MAX_BACKLOG      (1)         // Telemetry packets waiting in txq
+#define STREAM_LOSS_BACKOFF     (0x2000)    // 12.5% loss, slow down
+#define STREAM_LOSS_PACK_2      (0x0800)    // 3% loss, pack 2 samples
+#define STREAM_LOSS_PACK_4      (0x1800)    // 9% loss, pack 4 samples
 
 typedef enum {
     TELEM_IDLE = 0,
@@ -68,7 +84,15 @@ typedef enum {
 // =========== Static Variables ================================================
 static unsigned char is_ready = 0, is_streaming = 0;
 static TelemStatus status = TELEM_IDLE;
-static unsigned int iter_num, subsample_period, stream_addr;
+static unsigned int iter_num, subsample_period, stream_addr, agg_addr;
+
+static unsigned long stream_period, stream_next;
+static unsigned int stream_pack, stream_count;
+static TelemetryStructCompact stream_samples[STREAM_MAX_PACK];
+
+static unsigned char vision_streaming;
+static unsigned int vision_addr, vision_iter, vision_count;
+static TelemetryStructVision vision_samples[TELEMETRY_VISION_PACK];
 
 static PoolBuffStruct telem_buff;
 static TelemetryDatapoint datapoints[TELEM_BUFF_SIZE];
@@ -79,6 +103,14 @@ static unsigned int mem_page_pos, mem_byte_pos, mem_buff_index;
 // =========== Function Stubs ==================================================
 void telemPopulateB(TelemetryB); 
 void telemPopulateAttitude(TelemetryAttitude);
+void telemPopulateCompact(TelemetryCompact, unsigned char rssi);
+void telemPopulateVision(TelemetryVision, CvResult info);
+
+static void telemStream(void);
+static void telemAdaptStream(DirEntry entry);
+static void telemSendPacked(void);
+static void telemPumpVision(void);
+static void telemSendVision(void);
 
 // =========== Public Methods ==================================================
 void telemSetup(void) {
@@ -101,6 +133,8 @@ void telemSetup(void) {
     iter_num = 0;
     subsample_period = DEFAULT_SUBSAMPLE;
     
+    agg_addr = 0;
+    vision_streaming = 0;
     is_ready = 1;
     is_streaming = 0;
 
@@ -114,27 +148,63 @@ void telemToggleStreaming(unsigned int addr) {
     if(is_streaming) {
         is_streaming = 0;
     } else {
-        is_streaming = 1;
+        stream_period = STREAM_BASE_PERIOD;
+        stream_next = sclockGetLocalTicks();
+        stream_pack = 1;
+        stream_count = 0;
         stream_addr = addr;
+        is_streaming = 1;
+    }
+}
+
+void telemSetAggregator(unsigned int addr) {
+
+    agg_addr = addr;
+    stream_count = 0;
+
+}
+
+void telemToggleVisionStreaming(unsigned int addr) {
+
+    vision_streaming = !vision_streaming;
+    vision_addr = addr;
+    vision_iter = 0;
+    vision_count = 0;
+
+}
+
+void telemAddVision(CvResult info) {
+
+    if(!is_ready || !vision_streaming) { return; }
+
+    if(vision_iter++ % subsample_period != 0) { return; }
+
+    telemPopulateVision(&vision_samples[vision_count++], info);
+    if(vision_count >= TELEMETRY_VISION_PACK) {
+        telemSendVision();
+        vision_count = 0;
     }
+
 }
 
 void telemStartLogging(void) {
 
+    unsigned int i;
+
     if(!is_ready) { return; }
 
     mem_page_pos = DEFAULT_START_PAGE;
     mem_byte_pos = 0;
     mem_buff_index = 0;
 
-    dfmemEraseChip();
-//    unsigned int i;
-//    i = mem_page_pos;
-//    while(i < mem_geo.max_pages/4) {
-//        dfmemEraseSector(i);
-//        i += mem_geo.pages_per_sector;
-//    }
-    
+    // Erase only the log region, calibration is kept in the first sector
+    i = mem_page_pos;
+    while(i < mem_geo.max_pages) {
+        dfmemEraseSector(i);
+        i += mem_geo.pages_per_sector;
+    }
+
+
     while(!dfmemIsReady());
     status = TELEM_LOGGING;
     LED_RED = 1;
@@ -149,12 +219,18 @@ void telemStopLogging(void) {
     
 }
 
+unsigned char telemIsLogging(void) {
+
+    return status == TELEM_LOGGING;
+
+}
+
 
 
 void telemLog(void) {
 
     TelemetryDatapoint *data;
-    //RadioStatus radio_stat;
+    RadioStatus radio_stat;
     
     if(!is_ready) { return; }
     if(status != TELEM_LOGGING) { return; }
@@ -166,9 +242,9 @@ void telemLog(void) {
     if(data == NULL) { return; }
     
     rgltrGetState(&data->reg_state); // Fetch regulator data
-    //(&radio_stat);
-    //data->ED = radio_stat.last_ed;
-    //data->RSSI = radio_stat.last_rssi;
+    radioGetStatus(&radio_stat);
+    data->ED = radio_stat.last_ed;
+    data->RSSI = radio_stat.last_rssi;
     pbuffAddActive(&telem_buff, data); // Queue data
 
 }
@@ -181,7 +257,12 @@ void telemProcess(void) {
     if(!is_ready) { return; }
 
     if (is_streaming) {
-        telemSendB(stream_addr);
+        telemStream();
+    }
+
+    // Tracking digests its own frames
+    if(vision_streaming && !behavIsRunning()) {
+        telemPumpVision();
     }
 
     if(mem_page_pos >= mem_geo.max_pages) { telemStopLogging(); }
@@ -216,16 +297,14 @@ void telemSendB(unsigned int addr) {
 	telemPopulateB(&telemetryB);
 	
 	// Create a radio packet
-	packet = radioRequestPacket(TELEMETRY_B_SIZE);
+	packet = meshRequestPacket(TELEMETRY_B_SIZE);
 	if(packet == NULL) { return; }
-        macSetDestAddr(packet, addr);
-        macSetDestPan(packet, netGetLocalPanID());
 
 	// Write the telemetry struct into the packet payload
 	pld = macGetPayload(packet);
 	paySetType(pld, CMD_RESPONSE_TELEMETRY);
 	paySetData(pld, TELEMETRY_B_SIZE, (unsigned char *) &telemetryB);
-	if(!radioEnqueueTxPacket(packet)) {
+	if(!meshSend(packet, addr, NULL, NULL)) {
 		radioReturnPacket(packet);	// Delete packet if append fails
 	}
 	
@@ -241,21 +320,109 @@ void telemSendAttitude(unsigned int addr) {
 	telemPopulateAttitude(&telemetryAtt);
 	
 	// Create a radio packet
-	packet = radioRequestPacket(TELEMETRY_ATT_SIZE);
+	packet = meshRequestPacket(TELEMETRY_ATT_SIZE);
 	if(packet == NULL) { return; }
-        macSetDestAddr(packet, addr);
-        macSetDestPan(packet, netGetLocalPanID());
 
 	// Write the telemetry struct into the packet payload
 	pld = macGetPayload(packet);
 	paySetType(pld, CMD_RESPONSE_ATTITUDE);
 	paySetData(pld, TELEMETRY_ATT_SIZE, (unsigned char *) &telemetryAtt);
-	if(!radioEnqueueTxPacket(packet)) {
+	if(!meshSend(packet, addr, NULL, NULL)) {
         radioReturnPacket(packet);	// Delete packet if append fails
 	}
 	
 }
 
+// Sends one stream sample when due. The period and packing follow the link
+// quality of the destination so that streaming stays below saturation.
+static void telemStream(void) {
+
+    DirEntry entry;
+    unsigned long now;
+    unsigned int dest;
+
+    now = sclockGetLocalTicks();
+    if((long)(now - stream_next) < 0) { return; }
+
+    dest = (agg_addr != 0) ? agg_addr : stream_addr;
+    entry = dirQueryAddress(dest, netGetLocalPanID());
+    telemAdaptStream(entry);
+    stream_next = now + stream_period;
+
+    // Drop the sample rather than queue behind a full link
+    if(txqGetCredits() <= STREAM_MIN_CREDITS) { return; }
+
+    // Aggregators only take compact samples
+    if(agg_addr == 0 && stream_pack <= 1 && stream_count == 0) {
+        telemSendB(stream_addr);
+        return;
+    }
+
+    telemPopulateCompact(&stream_samples[stream_count++],
+                        (entry == NULL) ? 0 : entry->rssi >> 8);
+    if(stream_count >= stream_pack) {
+        telemSendPacked();
+        stream_count = 0;
+    }
+
+}
+
+// Multiplicative backoff on congestion or loss, gradual recovery otherwise
+static void telemAdaptStream(DirEntry entry) {
+
+    TxqStatsStruct stats;
+    unsigned int loss;
+    unsigned char congested;
+
+    loss = (entry == NULL) ? 0 : entry->loss;
+    txqGetStats(TXQ_CLASS_TELEMETRY, &stats, 0);
+    congested = stats.pending > STREAM_MAX_BACKLOG ||
+                txqGetCredits() <= STREAM_MIN_CREDITS;
+
+    if(congested || loss > STREAM_LOSS_BACKOFF) {
+        stream_period = stream_period*2;
+        if(stream_period > STREAM_MAX_PERIOD) { stream_period = STREAM_MAX_PERIOD; }
+    } else if(stream_period > STREAM_BASE_PERIOD) {
+        stream_period -= (stream_period - STREAM_BASE_PERIOD + 7)/8;
+    }
+
+    // Fewer, larger packets when frames are being lost
+    if(loss > STREAM_LOSS_PACK_4) {
+        stream_pack = 4;
+    } else if(loss > STREAM_LOSS_PACK_2) {
+        stream_pack = 2;
+    } else {
+        stream_pack = 1;
+    }
+
+}
+
+static void telemSendPacked(void) {
+
+    MacPacket packet;
+    Payload pld;
+    unsigned int size, dest;
+
+    if(agg_addr == netGetLocalAddress()) {
+        aggAddSamples(agg_addr, stream_samples, stream_count);
+        return;
+    }
+
+    dest = (agg_addr != 0) ? agg_addr : stream_addr;
+    size = stream_count*TELEMETRY_COMPACT_SIZE;
+    packet = meshRequestPacket(size);
+    if(packet == NULL) { return; }
+
+    pld = macGetPayload(packet);
+    paySetType(pld, CMD_RESPONSE_TELEMETRY_PACKED);
+    paySetStatus(pld, stream_count);
+    paySetData(pld, size, (unsigned char *) stream_samples);
+    if(!meshSend(packet, dest, NULL, NULL)) {
+        radioReturnPacket(packet);
+    }
+
+}
+
 void telemPopulateB(TelemetryB telemetry) {	    
 
     RegulatorStateStruct state;
@@ -269,7 +436,98 @@ void telemPopulateAttitude(TelemetryAttitude att) {
 
     Quaternion pose;
     
-    attGetQuat(&pose);
+    gsampGetQuat(&pose);
     memcpy(att, &pose, sizeof(Quaternion));    
 
 }
+
+void telemPopulateCompact(TelemetryCompact telemetry, unsigned char rssi) {
+
+    RegulatorStateStruct state;
+
+    rgltrGetState(&state);
+    telemetry->time = state.time + sclockGetOffsetTicks();
+
+    telemetry->ref[0] = (int)(state.ref.w*TELEMETRY_QUAT_SCALE);
+    telemetry->ref[1] = (int)(state.ref.x*TELEMETRY_QUAT_SCALE);
+    telemetry->ref[2] = (int)(state.ref.y*TELEMETRY_QUAT_SCALE);
+    telemetry->ref[3] = (int)(state.ref.z*TELEMETRY_QUAT_SCALE);
+
+    telemetry->pose[0] = (int)(state.pose.w*TELEMETRY_QUAT_SCALE);
+    telemetry->pose[1] = (int)(state.pose.x*TELEMETRY_QUAT_SCALE);
+    telemetry->pose[2] = (int)(state.pose.y*TELEMETRY_QUAT_SCALE);
+    telemetry->pose[3] = (int)(state.pose.z*TELEMETRY_QUAT_SCALE);
+
+    telemetry->u[0] = (signed char)(state.u[0]*127.0);
+    telemetry->u[1] = (signed char)(state.u[1]*127.0);
+    telemetry->u[2] = (signed char)(state.u[2]*127.0);
+
+    telemetry->RSSI = rssi;
+
+}
+
+static void telemPumpVision(void) {
+
+    CamFrame frame;
+    CvResultStruct info;
+
+    frame = camGetFrame();
+    if(frame == NULL) { return; }
+
+    cvProcessFrame(frame, &info);
+    camReturnFrame(frame);
+    telemAddVision(&info);
+
+}
+
+// Digests are dropped rather than queued behind a full link
+static void telemSendVision(void) {
+
+    MacPacket packet;
+    Payload pld;
+    unsigned int size;
+
+    if(txqGetCredits() <= STREAM_MIN_CREDITS) { return; }
+
+    size = vision_count*TELEMETRY_VISION_SIZE;
+    packet = meshRequestPacket(size);
+    if(packet == NULL) { return; }
+
+    pld = macGetPayload(packet);
+    paySetType(pld, CMD_RESPONSE_VISION_PACKED);
+    paySetStatus(pld, vision_count);
+    paySetData(pld, size, (unsigned char *) vision_samples);
+    if(!meshSend(packet, vision_addr, NULL, NULL)) {
+        radioReturnPacket(packet);
+    }
+
+}
+
+void telemPopulateVision(TelemetryVision telemetry, CvResult info) {
+
+    CvBlobStruct blobs[CV_MAX_BLOBS];
+    unsigned int i, num;
+    unsigned long mass;
+
+    telemetry->time = info->timestamp;
+    telemetry->frame_num = info->frame_num;
+    telemetry->centroid[0] = info->centroid[0];
+    telemetry->centroid[1] = info->centroid[1];
+    telemetry->max[0] = info->max[0];
+    telemetry->max[1] = info->max[1];
+    telemetry->max_lum = info->max_lum;
+    telemetry->avg_lum = info->avg_lum;
+    mass = info->mass >> 4;
+    telemetry->mass = (mass > 0xFFFF) ? 0xFFFF : mass;
+    telemetry->level = info->level;
+
+    num = cvGetBlobs(blobs, CV_MAX_BLOBS);
+    telemetry->num_blobs = num;
+    memset(telemetry->blobs, 0, sizeof(telemetry->blobs));
+    for(i = 0; i < num && i < TELEMETRY_VISION_BLOBS; i++) {
+        telemetry->blobs[i].col = blobs[i].col;
+        telemetry->blobs[i].row = blobs[i].row;
+        telemetry->blobs[i].address = blobs[i].address;
+    }
+
+}
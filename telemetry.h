@@ -39,11 +39,12 @@
 #include "bams.h"
 #include "quat.h"
 #include "regulator.h"
+#include "cv.h"
 
 typedef struct {
     RegulatorStateStruct reg_state;
-    //unsigned char ED;
-   // unsigned char RSSI;
+    unsigned char ED;
+    unsigned char RSSI;
 } TelemetryDatapoint;
  
 // State Telemetry Packet (Type B)
@@ -59,6 +60,43 @@ typedef struct {
 } TelemetryStructB;
 typedef TelemetryStructB* TelemetryB;
 
+// Compact State Telemetry (packed several per packet on poor links)
+// Quaternion components are scaled by TELEMETRY_QUAT_SCALE
+#define TELEMETRY_COMPACT_SIZE  (24)
+#define TELEMETRY_QUAT_SCALE    (32767.0)
+typedef struct {
+    unsigned long time;     // (4) Global time
+    int ref[4];             // (8) Reference
+    int pose[4];            // (8) Position
+    signed char u[3];       // (3) Output scaled to +-127
+    unsigned char RSSI;     // (1) Link RSSI average
+} TelemetryStructCompact;
+typedef TelemetryStructCompact* TelemetryCompact;
+
+// Compact vision digest, one per processed frame
+#define TELEMETRY_VISION_SIZE   (24)
+#define TELEMETRY_VISION_BLOBS  (2)
+#define TELEMETRY_VISION_PACK   (4)     // Digests per packet
+typedef struct {
+    unsigned char col;
+    unsigned char row;
+    unsigned int address;   // Decoded beacon address, 0 if unknown
+} TelemetryVisionBlob;
+
+typedef struct {
+    unsigned long time;     // (4) Global time of exposure midpoint
+    unsigned int frame_num; // (2) Camera frame number
+    unsigned char centroid[2]; // (2) Column, row
+    unsigned char max[2];   // (2) Brightest pixel column, row
+    unsigned char max_lum;  // (1) Brightest pixel luminosity
+    unsigned char avg_lum;  // (1) Average luminosity
+    unsigned int mass;      // (2) Total luminosity/16, saturated
+    unsigned char level;    // (1) CvLevel of the frame
+    unsigned char num_blobs; // (1) Beacons tracked
+    TelemetryVisionBlob blobs[TELEMETRY_VISION_BLOBS]; // (8) First beacons
+} TelemetryStructVision;
+typedef TelemetryStructVision* TelemetryVision;
+
 #define TELEMETRY_ATT_SIZE  (16)
 typedef struct {
     Quaternion att;
@@ -69,8 +107,18 @@ void telemSetup(void);
 void telemSetSubsampleRate(unsigned int rate);
 void telemStartLogging(void);
 void telemStopLogging(void);
+unsigned char telemIsLogging(void);
 void telemToggleStreaming(unsigned int addr);
 
+// Stream compact samples through an aggregator, 0 to stream directly
+void telemSetAggregator(unsigned int addr);
+
+// Stream vision digests of every subsample period'th frame to addr
+void telemToggleVisionStreaming(unsigned int addr);
+
+// Digest a processed frame for vision streaming
+void telemAddVision(CvResult info);
+
 // Writes into the buffer
 void telemLog(void);
 // Process the buffer
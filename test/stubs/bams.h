@@ -0,0 +1,8 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __BAMS_H
+#define __BAMS_H
+
+typedef int bams16_t;
+typedef long bams32_t;
+
+#endif
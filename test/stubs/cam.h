@@ -0,0 +1,22 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __CAM_H
+#define __CAM_H
+
+#define DS_IMAGE_ROWS           (40)
+#define DS_IMAGE_COLS           (40)
+
+typedef struct {
+    unsigned long frame_start;
+    unsigned long frame_period;
+} CamParamStruct;
+typedef CamParamStruct* CamParam;
+
+typedef struct {
+    unsigned long timestamp;
+    unsigned int frame_num;
+} CamFrameStruct;
+typedef CamFrameStruct* CamFrame;
+
+void camGetParams(CamParam params);
+
+#endif
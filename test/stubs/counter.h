@@ -0,0 +1,5 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __COUNTER_H
+#define __COUNTER_H
+
+#endif
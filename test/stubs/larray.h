@@ -0,0 +1,8 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __LARRAY_H
+#define __LARRAY_H
+
+typedef void* LinArrayItem;
+typedef unsigned int (*LinArrayItemTest)(LinArrayItem item, void *args);
+
+#endif
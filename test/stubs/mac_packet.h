@@ -0,0 +1,20 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __MAC_PACKET_H
+#define __MAC_PACKET_H
+
+#include "payload.h"
+
+typedef struct {
+    unsigned char seq_num;
+    unsigned int src_addr;
+    unsigned int src_pan;
+    Payload payload;
+} MacPacketStruct;
+typedef MacPacketStruct* MacPacket;
+
+unsigned int macGetSrcAddr(MacPacket packet);
+unsigned int macGetSrcPan(MacPacket packet);
+void macSetDestAddr(MacPacket packet, unsigned int addr);
+Payload macGetPayload(MacPacket packet);
+
+#endif
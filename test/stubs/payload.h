@@ -0,0 +1,18 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __PAYLOAD_H
+#define __PAYLOAD_H
+
+typedef struct {
+    unsigned char *pld_data;
+    unsigned char data_length;
+} PayloadStruct;
+typedef PayloadStruct* Payload;
+
+unsigned char* payGetData(Payload pld);
+void paySetData(Payload pld, unsigned int len, unsigned char *data);
+void payAppendData(Payload pld, unsigned int loc, unsigned int len,
+                    unsigned char *data);
+void paySetStatus(Payload pld, unsigned char status);
+void paySetType(Payload pld, unsigned char type);
+
+#endif
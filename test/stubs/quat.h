@@ -0,0 +1,9 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __QUAT_H
+#define __QUAT_H
+
+typedef struct {
+    float w, x, y, z;
+} Quaternion;
+
+#endif
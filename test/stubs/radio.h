@@ -0,0 +1,17 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __RADIO_H
+#define __RADIO_H
+
+#include "mac_packet.h"
+
+typedef struct {
+    unsigned char state;
+    unsigned char last_rssi;
+    unsigned char last_ed;
+} RadioStatus;
+
+MacPacket radioRequestPacket(unsigned int data_size);
+unsigned int radioReturnPacket(MacPacket packet);
+void radioGetStatus(RadioStatus *status);
+
+#endif
@@ -0,0 +1,5 @@
+// Host stand-in for the library header, declares only what the tests use
+#ifndef __UTILS_H
+#define __UTILS_H
+
+#endif
@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Directory Contact Time Test
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Runs on the host against net.c and strobe_plan.c with the directory,
+ *    radio, camera and strobe calls stubbed out. From this directory:
+ *      gcc -std=gnu99 -I.. -Istubs -o test_link_contact \
+ *          test_link_contact.c ../net.c ../strobe_plan.c && ./test_link_contact
+ *  - Peers are only ever heard through received packets, so their contact
+ *    times come from netUpdateLinkQuality(). Long after boot, peers heard
+ *    recently must still count as fresh for the strobe planner, and peers
+ *    that went quiet must not.
+ */
+
+#include "net.h"
+#include "strobe_plan.h"
+#include "lstrobe.h"
+#include "directory.h"
+#include "radio.h"
+#include "txq.h"
+#include "cam.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_PEERS               (5)
+#define LOCAL_ADDR              (0x1021)    // net.c default
+#define LOCAL_PAN               (0x1005)
+#define FRAME_PERIOD            (20833)     // 30 Hz in ticks
+
+// =========== Static Variables ================================================
+static DirEntryStruct entries[NUM_PEERS];
+static unsigned int num_entries;
+static unsigned long now;
+
+// =========== Stubs ===========================================================
+
+void dirInit(unsigned int size) {
+
+    (void) size;
+    memset(entries, 0, sizeof(entries));
+    num_entries = 0;
+
+}
+
+DirEntry dirAddNew(void) {
+
+    if(num_entries >= NUM_PEERS) { return NULL; }
+    return &entries[num_entries++];
+
+}
+
+DirEntry dirQueryAddress(unsigned int addr, unsigned int pan) {
+
+    unsigned int i;
+
+    for(i = 0; i < num_entries; i++) {
+        if(entries[i].address == addr && entries[i].pan_id == pan) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+
+}
+
+unsigned int dirQueryN(DirEntryTest test, void *args, DirEntry *dst,
+                        unsigned int max) {
+
+    unsigned int i, num;
+
+    num = 0;
+    for(i = 0; i < num_entries && num < max; i++) {
+        if(test(&entries[i], args)) { dst[num++] = &entries[i]; }
+    }
+    return num;
+
+}
+
+void radioGetStatus(RadioStatus *status) {
+
+    memset(status, 0, sizeof(RadioStatus));
+    status->last_rssi = 30;     // Well above the quality floor
+    status->last_ed = 30;
+
+}
+
+MacPacket radioRequestPacket(unsigned int data_size) { (void) data_size; return NULL; }
+unsigned int radioReturnPacket(MacPacket packet) { (void) packet; return 1; }
+
+unsigned int macGetSrcAddr(MacPacket packet) { return packet->src_addr; }
+unsigned int macGetSrcPan(MacPacket packet) { return packet->src_pan; }
+void macSetDestAddr(MacPacket packet, unsigned int addr) { (void) packet; (void) addr; }
+Payload macGetPayload(MacPacket packet) { return packet->payload; }
+
+unsigned char* payGetData(Payload pld) { return pld->pld_data; }
+void paySetData(Payload pld, unsigned int len, unsigned char *data) {
+    (void) pld; (void) len; (void) data;
+}
+void payAppendData(Payload pld, unsigned int loc, unsigned int len,
+                    unsigned char *data) {
+    (void) pld; (void) loc; (void) len; (void) data;
+}
+void paySetStatus(Payload pld, unsigned char status) { (void) pld; (void) status; }
+void paySetType(Payload pld, unsigned char type) { (void) pld; (void) type; }
+
+unsigned int txqSend(MacPacket packet, TxqCallback callback, void *args) {
+    (void) packet; (void) callback; (void) args;
+    return 0;
+}
+
+unsigned long sclockGetLocalTicks(void) { return now; }
+
+void camGetParams(CamParam params) {
+
+    params->frame_start = 0;
+    params->frame_period = FRAME_PERIOD;
+
+}
+
+void lstrobeGetParam(LStrobeParam params) {
+
+    memset(params, 0, sizeof(LStrobeParamStruct));
+    params->on_time = 156;
+
+}
+
+void lstrobeSetId(unsigned int id) { (void) id; }
+void lstrobeSetPhase(unsigned long offset) { (void) offset; }
+unsigned int lstrobeTrack(DirEntry entry) { (void) entry; return 1; }
+unsigned int lstrobeIsTracking(void) { return 1; }
+
+// =========== Test ============================================================
+
+// Receive one packet from every peer at the current time
+static void hearPeers(void) {
+
+    MacPacketStruct packet;
+    unsigned int i;
+
+    memset(&packet, 0, sizeof(MacPacketStruct));
+    packet.src_pan = LOCAL_PAN;
+    for(i = 0; i < NUM_PEERS; i++) {
+        packet.src_addr = LOCAL_ADDR + 1 + i;
+        packet.seq_num = i;
+        netUpdateLinkQuality(&packet);
+    }
+
+}
+
+static unsigned int planBeacons(void) {
+
+    SplanStruct plan;
+
+    splanSetup();
+    splanProcess();
+    splanGetPlan(&plan);
+    return plan.num_beacons;
+
+}
+
+int main(void) {
+
+    unsigned int beacons, failures;
+
+    failures = 0;
+    now = 0;
+    netSetup(NUM_PEERS);
+    hearPeers();
+
+    // Heard at boot only, long stale by now
+    now = 3*SPLAN_STALE_TIME;
+    beacons = planBeacons();
+    printf("quiet peers: %u beacons\n", beacons);
+    if(beacons != 1) { failures++; }
+
+    // Heard again just now
+    hearPeers();
+    now += SPLAN_STALE_TIME/2;
+    beacons = planBeacons();
+    printf("heard peers: %u beacons\n", beacons);
+    if(beacons != NUM_PEERS + 1) { failures++; }
+
+    printf(failures ? "FAIL\n" : "PASS\n");
+    return failures ? 1 : 0;
+
+}
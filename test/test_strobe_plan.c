@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *
+ * Strobe Slot Planner Test
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Runs on the host against strobe_plan.c with the directory, network,
+ *    camera and strobe calls stubbed out. From this directory:
+ *      gcc -std=gnu99 -I.. -Istubs -o test_strobe_plan \
+ *          test_strobe_plan.c ../strobe_plan.c && ./test_strobe_plan
+ *  - Six birds, four of them with cameras on one period. Every bird plans
+ *    over the same directory. The birds must agree on the reference, and
+ *    the flashes of birds sharing a frame must not overlap. No flash may
+ *    straddle a frame boundary of any camera.
+ */
+
+#include "strobe_plan.h"
+#include "lstrobe.h"
+#include "directory.h"
+#include "cam.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_BIRDS               (6)
+#define FRAME_PERIOD            (20833)     // 30 Hz in ticks
+#define ON_TIME                 (156)       // Timer 3 counts, 1 ms
+#define FLASH_TICKS             (ON_TIME << 2)
+
+// =========== Static Variables ================================================
+static DirEntryStruct birds[NUM_BIRDS];
+static unsigned int local;
+static unsigned long phase;
+static DirEntry tracked;
+
+static const unsigned int addresses[NUM_BIRDS] =
+    { 0x2010, 0x2011, 0x2012, 0x2013, 0x2014, 0x2015 };
+// Frame start of each camera, 0 for birds without one
+static const unsigned long frame_starts[NUM_BIRDS] =
+    { 5000, 8000, 0, 14000 + 7*FRAME_PERIOD, 0, 20000 };
+
+// =========== Stubs ===========================================================
+
+unsigned int netGetLocalAddress(void) { return local; }
+unsigned int netGetLocalPanID(void) { return 1; }
+unsigned long sclockGetLocalTicks(void) { return 1000; }
+
+unsigned int dirQueryN(DirEntryTest test, void *args, DirEntry *entries,
+                        unsigned int max) {
+
+    unsigned int i, num;
+
+    num = 0;
+    for(i = 0; i < NUM_BIRDS && num < max; i++) {
+        if(birds[i].address == local) { continue; }
+        if(test(&birds[i], args)) { entries[num++] = &birds[i]; }
+    }
+    return num;
+
+}
+
+void camGetParams(CamParam params) {
+
+    unsigned int i;
+
+    memset(params, 0, sizeof(CamParamStruct));
+    for(i = 0; i < NUM_BIRDS; i++) {
+        if(birds[i].address != local) { continue; }
+        params->frame_start = birds[i].frame_start;
+        params->frame_period = birds[i].frame_period;
+    }
+
+}
+
+void lstrobeGetParam(LStrobeParam params) {
+
+    memset(params, 0, sizeof(LStrobeParamStruct));
+    params->on_time = ON_TIME;
+
+}
+
+void lstrobeSetId(unsigned int id) { (void) id; }
+void lstrobeSetPhase(unsigned long offset) { phase = offset; }
+unsigned int lstrobeTrack(DirEntry entry) { tracked = entry; return 1; }
+unsigned int lstrobeIsTracking(void) { return tracked != NULL; }
+
+// =========== Test ============================================================
+
+// Flash start within the frame, relative to the frame start of a camera
+static unsigned long relativeStart(SplanStruct *plan, DirEntry cam) {
+
+    long rel;
+
+    rel = (long)(tracked->frame_start + plan->offset - cam->frame_start);
+    rel %= FRAME_PERIOD;
+    return rel < 0 ? rel + FRAME_PERIOD : rel;
+
+}
+
+int main(void) {
+
+    SplanStruct plans[NUM_BIRDS];
+    unsigned long start[NUM_BIRDS], rel;
+    unsigned int i, j, failures;
+
+    memset(birds, 0, sizeof(birds));
+    for(i = 0; i < NUM_BIRDS; i++) {
+        birds[i].address = addresses[i];
+        birds[i].pan_id = 1;
+        birds[i].timestamp = 900;
+        if(frame_starts[i] == 0) { continue; }
+        birds[i].frame_start = frame_starts[i];
+        birds[i].frame_period = FRAME_PERIOD;
+    }
+
+    failures = 0;
+    for(i = 0; i < NUM_BIRDS; i++) {
+        local = addresses[i];
+        tracked = NULL;
+        splanSetup();
+        splanProcess();
+        splanGetPlan(&plans[i]);
+        if(tracked == NULL || plans[i].ref_addr != addresses[0]) {
+            printf("bird %x: reference %x\n", local, plans[i].ref_addr);
+            failures++;
+            continue;
+        }
+        start[i] = relativeStart(&plans[i], tracked);
+        printf("bird %x: slot %u.%u of %u, start %lu\n", local,
+            plans[i].slot, plans[i].sub_slot, plans[i].num_sub_slots, start[i]);
+
+        // Whole flash inside one exposure of every camera
+        for(j = 0; j < NUM_BIRDS; j++) {
+            if(birds[j].frame_period == 0) { continue; }
+            rel = relativeStart(&plans[i], &birds[j]);
+            if(rel + FLASH_TICKS > FRAME_PERIOD) {
+                printf("bird %x: flash crosses frame of %x\n", local,
+                    addresses[j]);
+                failures++;
+            }
+        }
+    }
+    if(failures) { goto done; }
+
+    // Birds in the same frame of the cycle must not overlap
+    for(i = 0; i < NUM_BIRDS; i++) {
+        for(j = i + 1; j < NUM_BIRDS; j++) {
+            if(plans[i].slot != plans[j].slot) { continue; }
+            if(start[i] < start[j] + FLASH_TICKS &&
+                start[j] < start[i] + FLASH_TICKS) {
+                printf("birds %x and %x overlap\n", addresses[i],
+                    addresses[j]);
+                failures++;
+            }
+        }
+    }
+
+    // A camera dropped by the strobe is tracked again on the next plan
+    tracked = NULL;
+    splanInvalidate();
+    splanProcess();
+    if(tracked == NULL) {
+        printf("bird %x: tracking not restored\n", local);
+        failures++;
+    }
+
+done:
+    printf(failures ? "FAIL\n" : "PASS\n");
+    return failures ? 1 : 0;
+
+}
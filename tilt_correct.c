@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Attitude Tilt Correction
+ *
+ * v.beta
+ */
+
+#include "tilt_correct.h"
+#include "journal.h"
+#include "timer.h"
+
+#include <math.h>
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static Quaternion correction;
+
+// Measurement updates waiting for the next control tick
+static Quaternion pending;
+static unsigned char is_pending;
+
+// =========== Function Stubs ==================================================
+static void getTilt(Quaternion *pose, float *roll, float *pitch);
+static float wrapAngle(float angle);
+
+// =========== Public Functions ================================================
+
+void tiltSetup(void) {
+
+    correction.w = 1.0;
+    correction.x = 0.0;
+    correction.y = 0.0;
+    correction.z = 0.0;
+    quatCopy(&pending, &correction);
+    is_pending = 0;
+    is_ready = 1;
+
+}
+
+void tiltReset(void) {
+
+    DisableIntT5;
+    correction.w = 1.0;
+    correction.x = 0.0;
+    correction.y = 0.0;
+    correction.z = 0.0;
+    quatCopy(&pending, &correction);
+    is_pending = 0;
+    EnableIntT5;
+
+}
+
+void tiltUpdate(void) {
+
+    Quaternion updated;
+
+    if(!is_ready || !is_pending) { return; }
+
+    quatMult(&pending, &correction, &updated);
+    quatNormalize(&updated);
+    quatCopy(&correction, &updated);
+    pending.w = 1.0;
+    pending.x = 0.0;
+    pending.y = 0.0;
+    pending.z = 0.0;
+    is_pending = 0;
+    jrnlTilt(&correction);
+
+}
+
+void tiltApply(Quaternion *pose) {
+
+    Quaternion temp;
+
+    if(!is_ready) { return; }
+
+    quatMult(&correction, pose, &temp);
+    quatCopy(pose, &temp);
+
+}
+
+void tiltGetCorrection(Quaternion *dst) {
+
+    DisableIntT5;
+    quatCopy(dst, &correction);
+    EnableIntT5;
+
+}
+
+unsigned int tiltAddMeasurement(float roll, float pitch, Quaternion *pose,
+                                float gain) {
+
+    Quaternion err, conj, temp, delta, updated;
+    float est_roll, est_pitch;
+
+    if(!is_ready) { return 0; }
+
+    getTilt(pose, &est_roll, &est_pitch);
+    err.w = 0.0;
+    err.x = wrapAngle(roll - est_roll);
+    err.y = wrapAngle(pitch - est_pitch);
+    err.z = 0.0;
+    if(fabsf(err.x) > TILT_MAX_ERROR || fabsf(err.y) > TILT_MAX_ERROR) {
+        return 0;
+    }
+
+    // Rotate the body frame error into the world frame
+    quatConj(pose, &conj);
+    quatMult(pose, &err, &temp);
+    quatMult(&temp, &conj, &err);
+
+    // Small rotation about the horizontal part of the error only
+    delta.w = 1.0;
+    delta.x = 0.5*gain*err.x;
+    delta.y = 0.5*gain*err.y;
+    delta.z = 0.0;
+    quatNormalize(&delta);
+
+    DisableIntT5;
+    quatMult(&delta, &pending, &updated);
+    quatCopy(&pending, &updated);
+    is_pending = 1;
+    EnableIntT5;
+
+    return 1;
+
+}
+
+// =========== Private Functions ===============================================
+
+// Roll about body x and pitch about body y, yaw-pitch-roll convention
+static void getTilt(Quaternion *q, float *roll, float *pitch) {
+
+    float sinp;
+
+    *roll = atan2f(2.0*(q->w*q->x + q->y*q->z),
+                    1.0 - 2.0*(q->x*q->x + q->y*q->y));
+    sinp = 2.0*(q->w*q->y - q->z*q->x);
+    if(sinp > 1.0) { sinp = 1.0; }
+    if(sinp < -1.0) { sinp = -1.0; }
+    *pitch = asinf(sinp);
+
+}
+
+static float wrapAngle(float angle) {
+
+    while(angle > M_PI) { angle -= 2.0*M_PI; }
+    while(angle < -M_PI) { angle += 2.0*M_PI; }
+    return angle;
+
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Attitude Tilt Correction
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Keeps a world frame correction rotation that is applied to the
+ *    attitude estimate every control iteration. External roll and pitch
+ *    measurements nudge the correction so that gyro drift in tilt stays
+ *    bounded. Heading is never changed.
+ *  - tiltApply() runs in the control interrupt. tiltAddMeasurement() may be
+ *    called from the background loop. Its updates are held until
+ *    tiltUpdate() folds them in on the next control tick, where the new
+ *    correction is journaled.
+ */
+
+#ifndef __TILT_CORRECT_H
+#define __TILT_CORRECT_H
+
+#include "quat.h"
+
+#define TILT_MAX_ERROR          (0.35)  // Measurements further off are outliers
+
+/**
+ * Set up tilt correction with an identity correction
+ */
+void tiltSetup(void);
+
+/**
+ * Discard the accumulated correction
+ */
+void tiltReset(void);
+
+/**
+ * Fold pending measurement updates into the correction. Call from the
+ * control interrupt before tiltApply().
+ */
+void tiltUpdate(void);
+
+/**
+ * Apply the correction to an attitude estimate in place
+ * @param pose - Attitude estimate
+ */
+void tiltApply(Quaternion *pose);
+
+/**
+ * Copy out the current correction rotation
+ */
+void tiltGetCorrection(Quaternion *correction);
+
+/**
+ * Move the correction towards a tilt measurement
+ * @param roll - Measured roll in radians
+ * @param pitch - Measured pitch in radians
+ * @param pose - Corrected attitude at the time of measurement
+ * @param gain - Fraction of the error removed, 0 to 1
+ * @return 1 if used, 0 if rejected as an outlier
+ */
+unsigned int tiltAddMeasurement(float roll, float pitch, Quaternion *pose,
+                                float gain);
+
+#endif // __TILT_CORRECT_H
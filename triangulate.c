@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Cooperative Bearing Triangulation
+ *
+ * v.beta
+ */
+
+#include "triangulate.h"
+#include "net.h"
+#include "radio.h"
+#include "txq.h"
+#include "mac_packet.h"
+#include "payload.h"
+#include "cmd_const.h"
+#include "lstrobe.h"
+#include "sys_clock.h"
+
+#include <math.h>
+#include <string.h>
+
+#define MIN_DETERMINANT         (1e-4)      // Rays too parallel to intersect
+#define DIR_SCALE               (32767.0)
+#define MAX_REPORT_ITEMS        (4)
+
+typedef struct {
+    unsigned long time;
+    unsigned int observer;
+    float origin[3];
+    float dir[3];
+} TriRayStruct;
+
+typedef struct {
+    unsigned int address;
+    unsigned int head, count;
+    TriRayStruct rays[TRI_WINDOW];
+    TriEstimateStruct estimate;
+} TriTargetStruct;
+
+typedef TriTargetStruct* TriTarget;
+
+// Bearing report layout, header followed by items
+typedef struct {
+    float origin[3];        // (12) Observer position
+} TriReportHeaderStruct;
+
+typedef struct {
+    unsigned long time;     // (4) Global time of observation
+    unsigned int target;    // (2) Observed address
+    int dir[3];             // (6) Bearing scaled by DIR_SCALE
+} TriReportItemStruct;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0, is_anchor;
+static float anchor_pos[3];
+static TriTargetStruct targets[TRI_MAX_TARGETS];
+
+// =========== Function Stubs ==================================================
+static TriTarget findTarget(unsigned int addr, unsigned char create);
+static void solveTarget(TriTarget target);
+static unsigned int getOwnPosition(float *pos);
+
+// =========== Public Functions ================================================
+
+void triSetup(void) {
+
+    memset(targets, 0, sizeof(targets));
+    is_anchor = 0;
+    is_ready = 1;
+
+}
+
+void triSetAnchor(float *pos) {
+
+    if(pos == NULL) {
+        is_anchor = 0;
+        return;
+    }
+    memcpy(anchor_pos, pos, sizeof(anchor_pos));
+    is_anchor = 1;
+
+}
+
+void triAddObservation(unsigned int observer, unsigned int target_addr,
+                        unsigned long time, float *origin, float *dir) {
+
+    TriTarget target;
+    TriRayStruct *ray;
+
+    if(!is_ready) { return; }
+
+    target = findTarget(target_addr, 1);
+    if(target == NULL) { return; }
+
+    ray = &target->rays[target->head];
+    ray->time = time;
+    ray->observer = observer;
+    memcpy(ray->origin, origin, sizeof(ray->origin));
+    memcpy(ray->dir, dir, sizeof(ray->dir));
+    target->head = (target->head + 1) % TRI_WINDOW;
+    if(target->count < TRI_WINDOW) { target->count++; }
+
+    solveTarget(target);
+
+}
+
+unsigned int triGetEstimate(unsigned int addr, TriEstimate estimate) {
+
+    TriTarget target;
+
+    if(!is_ready) { return 0; }
+
+    if(addr == netGetLocalAddress() && is_anchor) {
+        memcpy(estimate->pos, anchor_pos, sizeof(anchor_pos));
+        estimate->residual = 0.0;
+        estimate->time = sclockGetGlobalTicks();
+        estimate->num_rays = 0;
+        return 1;
+    }
+
+    target = findTarget(addr, 0);
+    if(target == NULL || target->estimate.num_rays == 0) { return 0; }
+    memcpy(estimate, &target->estimate, sizeof(TriEstimateStruct));
+    return 1;
+
+}
+
+void triObserveFrame(CvResult info) {
+
+    CvBlobStruct blobs[CV_MAX_BLOBS];
+    MacPacket packet;
+    Payload pld;
+    TriReportHeaderStruct header;
+    TriReportItemStruct items[MAX_REPORT_ITEMS];
+    unsigned int i, num_blobs, num_items;
+    float dir[3];
+
+    if(!is_ready) { return; }
+
+    // Beacon sightings are complete at the end of each strobe period
+    if(info->frame_num % LSTROBE_FRAMES_PER_FLASH != LSTROBE_FRAMES_PER_FLASH - 1) {
+        return;
+    }
+
+    // Rays are only useful to others from a known position
+    if(!getOwnPosition(header.origin)) { return; }
+
+    num_blobs = cvGetBlobs(blobs, CV_MAX_BLOBS);
+    num_items = 0;
+
+    for(i = 0; i < num_blobs; i++) {
+
+        if(blobs[i].address == 0 || !(blobs[i].history & 0x01)) { continue; }
+
+        cvProjectPixel(info, blobs[i].col, blobs[i].row, dir);
+        triAddObservation(netGetLocalAddress(), blobs[i].address,
+                            info->timestamp, header.origin, dir);
+        if(num_items == MAX_REPORT_ITEMS) { continue; }
+
+        items[num_items].time = info->timestamp;
+        items[num_items].target = blobs[i].address;
+        items[num_items].dir[0] = (int)(dir[0]*DIR_SCALE);
+        items[num_items].dir[1] = (int)(dir[1]*DIR_SCALE);
+        items[num_items].dir[2] = (int)(dir[2]*DIR_SCALE);
+        num_items++;
+
+    }
+
+    if(num_items == 0) { return; }
+
+    packet = radioRequestPacket(sizeof(TriReportHeaderStruct) +
+                                num_items*sizeof(TriReportItemStruct));
+    if(packet == NULL) { return; }
+    macSetDestAddr(packet, NETWORK_BROADCAST_ADDR);
+    macSetDestPan(packet, netGetLocalPanID());
+
+    pld = macGetPayload(packet);
+    paySetType(pld, CMD_BEARING_REPORT);
+    paySetStatus(pld, num_items);
+    payAppendData(pld, 0, sizeof(TriReportHeaderStruct), (unsigned char*) &header);
+    payAppendData(pld, sizeof(TriReportHeaderStruct),
+                num_items*sizeof(TriReportItemStruct), (unsigned char*) items);
+
+    if(!txqSend(packet, NULL, NULL)) {
+        radioReturnPacket(packet);
+    }
+
+}
+
+void triHandleReport(MacPacket packet) {
+
+    Payload pld;
+    TriReportHeaderStruct *header;
+    TriReportItemStruct *items;
+    unsigned int i, num_items, length;
+    float dir[3];
+
+    if(!is_ready) { return; }
+
+    pld = macGetPayload(packet);
+    length = payGetDataLength(pld);
+    if(length < sizeof(TriReportHeaderStruct)) { return; }
+
+    header = (TriReportHeaderStruct*) payGetData(pld);
+    items = (TriReportItemStruct*) (payGetData(pld) + sizeof(TriReportHeaderStruct));
+    num_items = (length - sizeof(TriReportHeaderStruct))/sizeof(TriReportItemStruct);
+
+    for(i = 0; i < num_items; i++) {
+        dir[0] = items[i].dir[0]/DIR_SCALE;
+        dir[1] = items[i].dir[1]/DIR_SCALE;
+        dir[2] = items[i].dir[2]/DIR_SCALE;
+        triAddObservation(macGetSrcAddr(packet), items[i].target,
+                            items[i].time, header->origin, dir);
+    }
+
+}
+
+// =========== Private Functions ===============================================
+
+// Finds the target slot for an address, optionally replacing the stalest
+static TriTarget findTarget(unsigned int addr, unsigned char create) {
+
+    unsigned int i;
+    TriTarget stalest;
+
+    stalest = &targets[0];
+    for(i = 0; i < TRI_MAX_TARGETS; i++) {
+        if(targets[i].count != 0 && targets[i].address == addr) {
+            return &targets[i];
+        }
+        if(targets[i].count == 0) {
+            stalest = &targets[i];
+        } else if(stalest->count != 0 &&
+                (long)(targets[i].estimate.time - stalest->estimate.time) < 0) {
+            stalest = &targets[i];
+        }
+    }
+
+    if(!create) { return NULL; }
+
+    memset(stalest, 0, sizeof(TriTargetStruct));
+    stalest->address = addr;
+    return stalest;
+
+}
+
+// Least squares intersection of the target's recent rays. Each ray with
+// origin p and direction d contributes M = I - d*d' to A and M*p to b. The
+// estimate solves A*x = b. Only rays sharing the newest ray's observer, and
+// so its heading, are used.
+static void solveTarget(TriTarget target) {
+
+    TriRayStruct *ray;
+    TriEstimate estimate;
+    float a[6], b[3], inv[6], det, proj, err, *p, *d, mp[3], x[3];
+    unsigned long now, newest;
+    unsigned int i, n, observer;
+
+    now = sclockGetGlobalTicks();
+    observer = target->rays[(target->head + TRI_WINDOW - 1) % TRI_WINDOW].observer;
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    n = 0;
+    newest = 0;
+
+    for(i = 0; i < target->count; i++) {
+
+        ray = &target->rays[i];
+        if(now - ray->time > TRI_MAX_AGE) { continue; }
+        if(ray->observer != observer) { continue; }
+
+        p = ray->origin;
+        d = ray->dir;
+
+        // Symmetric matrix stored as xx, xy, xz, yy, yz, zz
+        a[0] += 1.0 - d[0]*d[0];
+        a[1] -= d[0]*d[1];
+        a[2] -= d[0]*d[2];
+        a[3] += 1.0 - d[1]*d[1];
+        a[4] -= d[1]*d[2];
+        a[5] += 1.0 - d[2]*d[2];
+
+        proj = p[0]*d[0] + p[1]*d[1] + p[2]*d[2];
+        b[0] += p[0] - proj*d[0];
+        b[1] += p[1] - proj*d[1];
+        b[2] += p[2] - proj*d[2];
+
+        if(n == 0 || (long)(ray->time - newest) > 0) { newest = ray->time; }
+        n++;
+
+    }
+
+    estimate = &target->estimate;
+    estimate->num_rays = 0;
+    if(n < 2) { return; }
+
+    // Adjugate of the symmetric matrix
+    inv[0] = a[3]*a[5] - a[4]*a[4];
+    inv[1] = a[2]*a[4] - a[1]*a[5];
+    inv[2] = a[1]*a[4] - a[2]*a[3];
+    inv[3] = a[0]*a[5] - a[2]*a[2];
+    inv[4] = a[1]*a[2] - a[0]*a[4];
+    inv[5] = a[0]*a[3] - a[1]*a[1];
+    det = a[0]*inv[0] + a[1]*inv[1] + a[2]*inv[2];
+    if(fabsf(det) < MIN_DETERMINANT) { return; }
+
+    x[0] = (inv[0]*b[0] + inv[1]*b[1] + inv[2]*b[2])/det;
+    x[1] = (inv[1]*b[0] + inv[3]*b[1] + inv[4]*b[2])/det;
+    x[2] = (inv[2]*b[0] + inv[4]*b[1] + inv[5]*b[2])/det;
+
+    // Mean squared distance from the estimate to each ray
+    err = 0.0;
+    for(i = 0; i < target->count; i++) {
+        ray = &target->rays[i];
+        if(now - ray->time > TRI_MAX_AGE) { continue; }
+        if(ray->observer != observer) { continue; }
+        p = ray->origin;
+        d = ray->dir;
+        mp[0] = x[0] - p[0];
+        mp[1] = x[1] - p[1];
+        mp[2] = x[2] - p[2];
+        proj = mp[0]*d[0] + mp[1]*d[1] + mp[2]*d[2];
+        err += mp[0]*mp[0] + mp[1]*mp[1] + mp[2]*mp[2] - proj*proj;
+    }
+
+    memcpy(estimate->pos, x, sizeof(x));
+    estimate->residual = err/n;
+    estimate->time = newest;
+    estimate->num_rays = n;
+
+}
+
+static unsigned int getOwnPosition(float *pos) {
+
+    TriEstimateStruct estimate;
+
+    if(!triGetEstimate(netGetLocalAddress(), &estimate)) { return 0; }
+    memcpy(pos, estimate.pos, sizeof(estimate.pos));
+    return 1;
+
+}
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Cooperative Bearing Triangulation
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Birds observe identified strobe beacons, project them to world frame
+ *    bearings and broadcast the bearings together with their own position
+ *    estimate. Every bird intersects the rays it receives or measures for
+ *    each target, including itself.
+ *  - Bearings are rotated into the world frame with the observer's own
+ *    attitude. Yaw drifts separately on each bird and birds share no heading
+ *    reference, so rays from different observers are never combined. An
+ *    estimate uses only the rays of the observer that reported last, and
+ *    the baseline comes from that observer's motion within the window. A
+ *    hovering observer gives no estimate.
+ *  - Each target keeps a sliding window of rays. The estimate is the point
+ *    minimizing the squared perpendicular distance to all rays younger than
+ *    TRI_MAX_AGE global ticks, so cost per update is bounded by the window.
+ *  - Positions are anchored by birds with known positions, set with
+ *    triSetAnchor(). Other birds start contributing once localized.
+ *  - Not interrupt safe. Call from the background loop only.
+ */
+
+#ifndef __TRIANGULATE_H
+#define __TRIANGULATE_H
+
+#include "mac_packet.h"
+#include "cv.h"
+
+#define TRI_WINDOW              (6)         // Rays kept per target
+#define TRI_MAX_TARGETS         (6)
+#define TRI_MAX_AGE             (1250000)   // 2 s (625 ticks/ms)
+
+typedef struct {
+    float pos[3];               // World frame position
+    float residual;             // Mean squared ray distance
+    unsigned long time;         // Global time of newest ray used
+    unsigned char num_rays;     // Rays used, 0 if no estimate
+} TriEstimateStruct;
+
+typedef TriEstimateStruct* TriEstimate;
+
+/**
+ * Set up triangulation module
+ */
+void triSetup(void);
+
+/**
+ * Fix this bird's position
+ * @param pos - World frame position, NULL to estimate it instead
+ */
+void triSetAnchor(float *pos);
+
+/**
+ * Add a ray towards a target
+ * @param observer - Network address of the bird that measured the ray
+ * @param target - Network address of observed bird
+ * @param time - Global time of observation
+ * @param origin - Observer position
+ * @param dir - World frame unit bearing
+ */
+void triAddObservation(unsigned int observer, unsigned int target,
+                        unsigned long time, float *origin, float *dir);
+
+/**
+ * Latest position estimate of a bird
+ * @param addr - Network address, the local address gives the own estimate
+ * @param estimate - Destination structure
+ * @return 1 if an estimate is available
+ */
+unsigned int triGetEstimate(unsigned int addr, TriEstimate estimate);
+
+/**
+ * Record identified beacons of a processed frame and broadcast them once
+ * per strobe period. Call with every frame after cvProcessFrame().
+ * @param info - Frame result
+ */
+void triObserveFrame(CvResult info);
+
+/**
+ * Use a neighbour's CMD_BEARING_REPORT packet
+ * @param packet - Received packet
+ */
+void triHandleReport(MacPacket packet);
+
+#endif // __TRIANGULATE_H
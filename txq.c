@@ -0,0 +1,419 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Asynchronous Radio Transmit Queue
+ *
+ * v.beta
+ */
+
+#include "txq.h"
+#include "radio.h"
+#include "mac_packet.h"
+#include "payload.h"
+#include "cmd_const.h"
+#include "sys_clock.h"
+#include "pbuff.h"
+#include "mesh.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TIMEOUT         (62500) // 100 ms (625 ticks/ms)
+#define RADIO_DEPTH             (2)     // Packets allowed in the radio FIFO
+#define PACKET_OVERHEAD         (13)    // MAC header, FCS and payload header
+#define MIN_QUANTUM             (16)
+
+typedef struct {
+    MacPacket packet;
+    TxqCallback callback;
+    void *args;
+    unsigned long enqueue_time;
+} TxqEntryStruct;
+
+typedef TxqEntryStruct* TxqEntry;
+
+// FIFO of entries for one traffic class
+typedef struct {
+    TxqEntry *items;
+    unsigned int head;
+    unsigned int count;
+    unsigned int quantum;
+    unsigned int deficit;
+    TxqStatsStruct stats;
+} TxqQueueStruct;
+
+typedef TxqQueueStruct* TxqQueue;
+
+// =========== Static Variables ================================================
+static unsigned char is_ready = 0;
+static unsigned int num_entries, num_pending, rr_class;
+static unsigned long timeout;
+
+static TxqEntryStruct *entries;
+static PoolBuffStruct entry_buff;
+static TxqQueueStruct queues[TXQ_NUM_CLASSES];
+
+// Default byte quanta, timing class is strict priority
+static const unsigned int default_quanta[TXQ_NUM_CLASSES] = {
+    0,      // TXQ_CLASS_TIMING
+    384,    // TXQ_CLASS_COMMAND
+    256,    // TXQ_CLASS_TELEMETRY
+    128,    // TXQ_CLASS_DIRECTORY
+    128,    // TXQ_CLASS_BULK
+};
+
+// =========== Function Stubs ==================================================
+static TxqClass classifyPacket(MacPacket packet);
+static int selectClass(void);
+static unsigned int entrySize(TxqEntry entry);
+static void queuePush(TxqQueue queue, TxqEntry entry);
+static TxqEntry queuePeek(TxqQueue queue);
+static TxqEntry queuePop(TxqQueue queue);
+static void expireStale(unsigned long now);
+static void completeEntry(TxqEntry entry, TxqResult result);
+
+// =========== Public Methods ==================================================
+void txqSetup(unsigned int size) {
+
+    unsigned int i;
+    TxqEntry items[size];
+
+    is_ready = 0;
+
+    entries = (TxqEntryStruct*) calloc(size, sizeof(TxqEntryStruct));
+    if(entries == NULL) { return; }
+
+    for(i = 0; i < size; i++) {
+        items[i] = &entries[i];
+    }
+
+    pbuffInit(&entry_buff, size, (PoolBuffItem*) items);
+    if(entry_buff.valid == 0) { return; }
+
+    // Each class can hold every entry so pushes never fail
+    for(i = 0; i < TXQ_NUM_CLASSES; i++) {
+        memset(&queues[i], 0, sizeof(TxqQueueStruct));
+        queues[i].items = (TxqEntry*) calloc(size, sizeof(TxqEntry));
+        if(queues[i].items == NULL) { return; }
+        queues[i].quantum = default_quanta[i];
+    }
+
+    num_entries = size;
+    num_pending = 0;
+    rr_class = TXQ_CLASS_COMMAND;
+    timeout = DEFAULT_TIMEOUT;
+    is_ready = 1;
+
+}
+
+void txqSetTimeout(unsigned long ticks) {
+
+    timeout = ticks;
+
+}
+
+void txqSetQuantum(TxqClass cls, unsigned int quantum) {
+
+    if(cls >= TXQ_NUM_CLASSES) { return; }
+    if(quantum < MIN_QUANTUM) { quantum = MIN_QUANTUM; }
+    queues[cls].quantum = quantum;
+
+}
+
+unsigned int txqSend(MacPacket packet, TxqCallback callback, void *args) {
+
+    if(packet == NULL) { return 0; }
+    return txqSendClass(packet, classifyPacket(packet), callback, args);
+
+}
+
+unsigned int txqSendClass(MacPacket packet, TxqClass cls,
+                        TxqCallback callback, void *args) {
+
+    TxqEntry entry;
+    TxqQueue queue;
+
+    if(!is_ready || packet == NULL) { return 0; }
+    if(cls >= TXQ_NUM_CLASSES) { return 0; }
+
+    entry = pbuffGetIdle(&entry_buff);
+    if(entry == NULL) { return 0; } // Out of credits
+
+    entry->packet = packet;
+    entry->callback = callback;
+    entry->args = args;
+    entry->enqueue_time = sclockGetLocalTicks();
+
+    queue = &queues[cls];
+    queuePush(queue, entry);
+    num_pending++;
+
+    queue->stats.pending = queue->count;
+    if(queue->count > queue->stats.max_pending) {
+        queue->stats.max_pending = queue->count;
+    }
+
+    return 1;
+
+}
+
+unsigned int txqGetCredits(void) {
+
+    if(!is_ready) { return 0; }
+    return num_entries - num_pending;
+
+}
+
+unsigned int txqIsEmpty(void) {
+
+    return num_pending == 0;
+
+}
+
+void txqGetStats(TxqClass cls, TxqStats stats, unsigned char clear) {
+
+    TxqQueue queue;
+
+    if(cls >= TXQ_NUM_CLASSES || stats == NULL) { return; }
+
+    queue = &queues[cls];
+    queue->stats.pending = queue->count;
+    memcpy(stats, &queue->stats, sizeof(TxqStatsStruct));
+
+    if(clear) {
+        memset(&queue->stats, 0, sizeof(TxqStatsStruct));
+        queue->stats.pending = queue->count;
+        queue->stats.max_pending = queue->count;
+    }
+
+}
+
+void txqFlush(void) {
+
+    unsigned int i;
+    TxqEntry entry;
+
+    if(!is_ready) { return; }
+
+    for(i = 0; i < TXQ_NUM_CLASSES; i++) {
+        while((entry = queuePop(&queues[i])) != NULL) {
+            radioReturnPacket(entry->packet);
+            queues[i].stats.dropped++;
+            completeEntry(entry, TXQ_FLUSHED);
+        }
+        queues[i].deficit = 0;
+    }
+
+}
+
+void txqProcess(void) {
+
+    int cls;
+    TxqQueue queue;
+    TxqEntry entry;
+    unsigned long now, latency;
+
+    if(!is_ready) { return; }
+
+    now = sclockGetLocalTicks();
+    expireStale(now);
+
+    // Keep the radio FIFO shallow so priorities take effect
+    while(radioGetTxQueueSize() < RADIO_DEPTH) {
+
+        cls = selectClass();
+        if(cls < 0) { return; }
+
+        queue = &queues[cls];
+        entry = queuePeek(queue);
+        if(!radioEnqueueTxPacket(entry->packet)) { return; } // Retry later
+
+        queuePop(queue);
+        if(cls != TXQ_CLASS_TIMING) {
+            queue->deficit -= entrySize(entry);
+        }
+
+        latency = now - entry->enqueue_time;
+        queue->stats.sent++;
+        queue->stats.total_latency += latency;
+        if(latency > queue->stats.max_latency) {
+            queue->stats.max_latency = latency;
+        }
+
+        completeEntry(entry, TXQ_SENT);
+
+    }
+
+}
+
+// =========== Private Functions ===============================================
+
+static TxqClass classifyPacket(MacPacket packet) {
+
+    unsigned char type;
+
+    type = payGetType(macGetPayload(packet));
+    // Relayed packets keep the class of what they carry
+    if(type == CMD_MESH_FORWARD) {
+        type = meshGetInnerType(packet);
+    }
+
+    switch(type) {
+
+        case CMD_CLOCK_UPDATE_REQUEST:
+        case CMD_CLOCK_UPDATE_RESPONSE:
+            return TXQ_CLASS_TIMING;
+
+        case CMD_RESPONSE_TELEMETRY:
+        case CMD_RESPONSE_TELEMETRY_PACKED:
+        case CMD_RESPONSE_TELEMETRY_AGGREGATE:
+        case CMD_RESPONSE_ATTITUDE:
+            return TXQ_CLASS_TELEMETRY;
+
+        case CMD_DIR_UPDATE_REQUEST:
+        case CMD_DIR_UPDATE_RESPONSE:
+        case CMD_DIR_DUMP_REQUEST:
+        case CMD_DIR_DUMP_RESPONSE:
+        case CMD_ROUTE_ADVERT:
+            return TXQ_CLASS_DIRECTORY;
+
+        case CMD_RAW_FRAME_RESPONSE:
+            return TXQ_CLASS_BULK;
+
+        default:
+            return TXQ_CLASS_COMMAND;
+
+    }
+
+}
+
+// Returns the class to serve next, or -1 if nothing is pending
+static int selectClass(void) {
+
+    TxqQueue queue;
+
+    if(num_pending == 0) { return -1; }
+    if(queues[TXQ_CLASS_TIMING].count > 0) { return TXQ_CLASS_TIMING; }
+
+    // Deficit round robin over the remaining classes. Terminates since at
+    // least one is backlogged and every visit grows its deficit.
+    while(1) {
+
+        queue = &queues[rr_class];
+        if(queue->count == 0) {
+            queue->deficit = 0;
+        } else if(entrySize(queuePeek(queue)) <= queue->deficit) {
+            return rr_class;
+        }
+
+        rr_class++;
+        if(rr_class >= TXQ_NUM_CLASSES) { rr_class = TXQ_CLASS_COMMAND; }
+
+        queue = &queues[rr_class];
+        if(queue->count > 0) {
+            queue->deficit += queue->quantum;
+        }
+
+    }
+
+}
+
+static unsigned int entrySize(TxqEntry entry) {
+
+    return payGetDataLength(macGetPayload(entry->packet)) + PACKET_OVERHEAD;
+
+}
+
+static void queuePush(TxqQueue queue, TxqEntry entry) {
+
+    unsigned int tail;
+
+    tail = (queue->head + queue->count) % num_entries;
+    queue->items[tail] = entry;
+    queue->count++;
+
+}
+
+static TxqEntry queuePeek(TxqQueue queue) {
+
+    if(queue->count == 0) { return NULL; }
+    return queue->items[queue->head];
+
+}
+
+static TxqEntry queuePop(TxqQueue queue) {
+
+    TxqEntry entry;
+
+    if(queue->count == 0) { return NULL; }
+    entry = queue->items[queue->head];
+    queue->head = (queue->head + 1) % num_entries;
+    queue->count--;
+    return entry;
+
+}
+
+// Each class is FIFO, so only heads need checking
+static void expireStale(unsigned long now) {
+
+    unsigned int i;
+    TxqEntry entry;
+
+    if(timeout == 0) { return; }
+
+    for(i = 0; i < TXQ_NUM_CLASSES; i++) {
+        while((entry = queuePeek(&queues[i])) != NULL) {
+            if(now - entry->enqueue_time <= timeout) { break; }
+            queuePop(&queues[i]);
+            radioReturnPacket(entry->packet);
+            queues[i].stats.dropped++;
+            completeEntry(entry, TXQ_TIMEOUT);
+        }
+    }
+
+}
+
+// Release the entry before running the callback so that it may send again
+static void completeEntry(TxqEntry entry, TxqResult result) {
+
+    TxqCallback callback;
+    void *args;
+
+    callback = entry->callback;
+    args = entry->args;
+
+    entry->packet = NULL;
+    pbuffReturn(&entry_buff, entry);
+    num_pending--;
+
+    if(callback != NULL) {
+        callback(result, args);
+    }
+
+}
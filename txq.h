@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2012, Regents of the University of California
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the University of California, Berkeley nor the names
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Asynchronous Radio Transmit Queue
+ *
+ * v.beta
+ *
+ * Notes:
+ *  - Producers hand packets to txqSend() and return immediately. Packets are
+ *    moved into the radio TX queue by txqProcess() as space opens up.
+ *  - Credits are the number of free queue slots. Streaming producers should
+ *    check txqGetCredits() before allocating a packet so that command
+ *    responses always find room.
+ *  - Packets are sorted into traffic classes by payload type. The timing
+ *    class is always served first; the remaining classes share the link by
+ *    deficit round robin weighted by byte quanta.
+ *  - Only a couple of packets are kept in the radio's own FIFO at a time so
+ *    that scheduling decisions are made as late as possible.
+ *  - Not interrupt safe. Call from the background loop only.
+ */
+
+#ifndef __TXQ_H
+#define __TXQ_H
+
+#include "mac_packet.h"
+
+typedef enum {
+    TXQ_SENT = 0,       // Packet accepted by radio
+    TXQ_TIMEOUT,        // Packet expired before radio accepted it
+    TXQ_FLUSHED,        // Packet discarded by txqFlush()
+} TxqResult;
+
+typedef enum {
+    TXQ_CLASS_TIMING = 0,   // Strict priority (clock sync)
+    TXQ_CLASS_COMMAND,      // Command responses and network control
+    TXQ_CLASS_TELEMETRY,    // Telemetry and attitude streaming
+    TXQ_CLASS_DIRECTORY,    // Directory updates and dumps
+    TXQ_CLASS_BULK,         // Flash and raw frame dumps
+    TXQ_NUM_CLASSES,
+} TxqClass;
+
+// Per-class counters, latencies are enqueue to radio handoff
+typedef struct {
+    unsigned int sent;
+    unsigned int dropped;
+    unsigned int pending;
+    unsigned int max_pending;
+    unsigned long total_latency;    // Ticks, sum over sent packets
+    unsigned long max_latency;      // Ticks
+} TxqStatsStruct;
+
+typedef TxqStatsStruct* TxqStats;
+
+// Completion callback. Packet ownership has already passed on when called.
+typedef void (*TxqCallback)(TxqResult result, void *args);
+
+/**
+ * Set up the transmit queue
+ * @param size - Maximum number of pending packets (total credits)
+ */
+void txqSetup(unsigned int size);
+
+/**
+ * Set the maximum time a packet may wait before being dropped
+ * @param ticks - Timeout in system clock ticks. 0 disables the timeout.
+ */
+void txqSetTimeout(unsigned long ticks);
+
+/**
+ * Set the deficit round robin quantum of a class
+ * @param cls - Traffic class. The timing class ignores its quantum.
+ * @param quantum - Bytes added to the class deficit each round
+ */
+void txqSetQuantum(TxqClass cls, unsigned int quantum);
+
+/**
+ * Queue a packet for transmission. Never blocks. The traffic class is
+ * chosen from the payload type.
+ * @param packet - Packet to send
+ * @param callback - Completion callback, or NULL
+ * @param args - Argument passed to callback
+ * @return 1 if queued, 0 if out of credits. On failure the caller still owns
+ *  the packet and should return it with radioReturnPacket().
+ */
+unsigned int txqSend(MacPacket packet, TxqCallback callback, void *args);
+
+/**
+ * Queue a packet in an explicit traffic class
+ * @see txqSend
+ */
+unsigned int txqSendClass(MacPacket packet, TxqClass cls,
+                        TxqCallback callback, void *args);
+
+/**
+ * Number of packets that can currently be queued
+ */
+unsigned int txqGetCredits(void);
+
+/**
+ * Returns 1 if no packets are pending, 0 otherwise
+ */
+unsigned int txqIsEmpty(void);
+
+/**
+ * Read and optionally clear the counters of a class
+ * @param cls - Traffic class
+ * @param stats - Struct to populate
+ * @param clear - Reset counters after reading if nonzero
+ */
+void txqGetStats(TxqClass cls, TxqStats stats, unsigned char clear);
+
+/**
+ * Drop all pending packets
+ */
+void txqFlush(void);
+
+/**
+ * Move pending packets into the radio and expire stale ones. Call regularly.
+ */
+void txqProcess(void);
+
+#endif